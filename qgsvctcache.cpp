@@ -0,0 +1,132 @@
+#include "qgsvctcache.h"
+#include "qgssettings.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSysInfo>
+
+namespace
+{
+	const quint32 CACHE_MAGIC = 0x56435443;//"VCTC"
+	const quint32 CACHE_VERSION = 6;
+
+	//the signature hashes this many blocks spread over the source file
+	const int SIGNATURE_BLOCK_COUNT = 64;
+	const qint64 SIGNATURE_BLOCK_SIZE = 64 * 1024;
+}
+
+QgsVctCache::QgsVctCache(const QString &sourcePath)
+	: mSourcePath(sourcePath)
+{
+	const QString directory = QgsSettings().value(QStringLiteral("providers/vct/cacheDirectory")).toString();
+	if (directory.isEmpty())
+	{
+		mPath = sourcePath + QStringLiteral(".cache");
+	}
+	else
+	{
+		//one file per source path, named after its hash
+		const QString canonicalPath = QFileInfo(sourcePath).canonicalFilePath();
+		const QByteArray key = QCryptographicHash::hash(canonicalPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+		mPath = QDir(directory).filePath(QString::fromLatin1(key) + QStringLiteral(".vctcache"));
+	}
+	mStream.setVersion(QDataStream::Qt_5_9);
+}
+
+QgsVctCache::~QgsVctCache()
+{
+	mStream.setDevice(nullptr);
+	if (mMap)
+		mFile.unmap(mMap);
+}
+
+bool QgsVctCache::isEnabled()
+{
+	return QgsSettings().value(QStringLiteral("providers/vct/cache"), true).toBool();
+}
+
+QByteArray QgsVctCache::sourceSignature() const
+{
+	QFile source(mSourcePath);
+	if (!source.open(QIODevice::ReadOnly))
+		return QByteArray();
+
+	const qint64 size = source.size();
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	if (size <= SIGNATURE_BLOCK_COUNT * SIGNATURE_BLOCK_SIZE)
+	{
+		hash.addData(source.readAll());
+	}
+	else
+	{
+		//hashing the whole file would cost as much as parsing it, sample blocks including the first and the last
+		const qint64 step = (size - SIGNATURE_BLOCK_SIZE) / (SIGNATURE_BLOCK_COUNT - 1);
+		for (int i = 0; i < SIGNATURE_BLOCK_COUNT; i++)
+		{
+			source.seek(i * step);
+			hash.addData(source.read(SIGNATURE_BLOCK_SIZE));
+		}
+	}
+
+	QByteArray signature;
+	QDataStream stream(&signature, QIODevice::WriteOnly);
+	stream << size << QFileInfo(source).lastModified().toMSecsSinceEpoch() << hash.result();
+	return signature;
+}
+
+bool QgsVctCache::open()
+{
+	mFile.setFileName(mPath);
+	if (!mFile.open(QIODevice::ReadOnly) || mFile.size() == 0)
+		return false;
+
+	//QByteArray is limited to 2 GB, larger sidecars are streamed from the file
+	if (mFile.size() <= std::numeric_limits<int>::max())
+		mMap = mFile.map(0, mFile.size());
+	if (mMap)
+	{
+		mMappedData = QByteArray::fromRawData(reinterpret_cast<const char *>(mMap), int(mFile.size()));
+		mBuffer.setBuffer(&mMappedData);
+		mBuffer.open(QIODevice::ReadOnly);
+		mStream.setDevice(&mBuffer);
+	}
+	else
+		mStream.setDevice(&mFile);
+
+	quint32 magic = 0;
+	quint32 version = 0;
+	qint32 byteOrder = -1;
+	qint32 pointerSize = 0;
+	QByteArray signature;
+	mStream >> magic >> version >> byteOrder >> pointerSize >> signature;
+	return mStream.status() == QDataStream::Ok && magic == CACHE_MAGIC && version == CACHE_VERSION
+		&& byteOrder == QSysInfo::ByteOrder && pointerSize == QSysInfo::WordSize
+		&& signature == sourceSignature();
+}
+
+bool QgsVctCache::create()
+{
+	const QByteArray signature = sourceSignature();
+	if (signature.isEmpty())
+		return false;
+
+	mSaveFile.setFileName(mPath);
+	if (!mSaveFile.open(QIODevice::WriteOnly))
+		return false;
+	mStream.setDevice(&mSaveFile);
+	mStream << CACHE_MAGIC << CACHE_VERSION << qint32(QSysInfo::ByteOrder) << qint32(QSysInfo::WordSize) << signature;
+	return true;
+}
+
+bool QgsVctCache::commit()
+{
+	mStream.setDevice(nullptr);
+	if (mStream.status() != QDataStream::Ok)
+	{
+		mSaveFile.cancelWriting();
+		return false;
+	}
+	return mSaveFile.commit();
+}
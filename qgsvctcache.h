@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QString>
+
+/**
+ * Binary sidecar file holding the parsed content of a VCT file.
+ *
+ * The sidecar starts with a signature of the source file (size, modification time and a
+ * hash of sampled blocks) and is only used while that signature matches. It is written next
+ * to the VCT file, or into the directory set in "providers/vct/cacheDirectory". The payload is
+ * written and read by the provider through stream(); on open the file is memory mapped and
+ * the stream reads straight from the mapping.
+ */
+class QgsVctCache
+{
+public:
+
+	explicit QgsVctCache(const QString &sourcePath);
+	~QgsVctCache();
+
+	//! Returns true when caching is enabled in the settings
+	static bool isEnabled();
+
+	//! Location of the sidecar file
+	QString path() const { return mPath; }
+
+	//! Maps the sidecar and checks it against the source file, the payload can then be read from stream()
+	bool open();
+
+	//! Starts a new sidecar, the payload is written to stream() and committed by commit()
+	bool create();
+	//! Atomically replaces the sidecar with the written payload
+	bool commit();
+
+	QDataStream &stream() { return mStream; }
+
+private:
+
+	//! Signature of the source file, empty if it can not be read
+	QByteArray sourceSignature() const;
+
+	QString mSourcePath;
+	QString mPath;
+
+	QFile mFile;
+	uchar *mMap = nullptr;
+	QByteArray mMappedData;
+	QBuffer mBuffer;
+
+	QSaveFile mSaveFile;
+	QDataStream mStream;
+};
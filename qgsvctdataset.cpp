@@ -0,0 +1,1161 @@
+#include "qgsvctdataset.h"
+#include "qgsvcttokenizer.h"
+#include "qgsvctcache.h"
+#include "qgsvctjournal.h"
+#include "qgslogger.h"
+#include "qgssettings.h"
+#include "vctcore/vctfile.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QObject>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+//Files above this size are parsed by several threads, in chunks of at least PARALLEL_READ_CHUNK_SIZE bytes
+static const qint64 PARALLEL_READ_THRESHOLD = 32 * 1024 * 1024;
+static const qint64 PARALLEL_READ_CHUNK_SIZE = 4 * 1024 * 1024;
+//smaller files are parsed faster than a sidecar cache is validated
+static const qint64 CACHE_MINIMUM_SIZE = 16 * 1024 * 1024;
+//MiB of geometries and attribute rows decoded from the file kept in memory, per layer
+static const int RECORD_CACHE_SIZE = 64;
+//datasets kept after their last provider is gone
+static const int RETAINED_DATASETS = 2;
+//bytes read between two progress reports of a background load
+static const qint64 PROGRESS_STEP = 1024 * 1024;
+
+//Decodes lazy geometries and deferred attribute rows from a mapping of the VCT file
+class QgsVctFileDecoder final : public QgsVctRecordDecoder
+{
+public:
+	explicit QgsVctFileDecoder(const QString &path)
+		: mTokenizer(path)
+	{
+	}
+
+	void decode(qint64 begin, qint64 end, QgsWkbTypes::GeometryType type, QgsVctFeatureStore &features) const override
+	{
+		QgsVctTokenizer record(mTokenizer, begin, end);
+		switch (type)
+		{
+		case QgsWkbTypes::PointGeometry:
+			QgsVctDataset::readPoint(record, features);
+			break;
+		case QgsWkbTypes::LineGeometry:
+			QgsVctDataset::readLine(record, features);
+			break;
+		case QgsWkbTypes::PolygonGeometry:
+			QgsVctDataset::readPolygon(record, features);
+			break;
+		default:
+			break;
+		}
+	}
+
+	QgsAttributes decodeAttributes(qint64 begin, qint64 end) const override
+	{
+		QgsVctTokenizer record(mTokenizer, begin, end);
+		const QgsVctLine line = record.readLine();
+		QgsAttributes values;
+		int pos = 0;
+		QgsVctLine field;
+		//the first field is the feature id
+		line.nextField(',', pos, field);
+		while (line.nextField(',', pos, field))
+			values.append(field.toString());
+		return values;
+	}
+
+	QByteArray text(qint64 begin, qint64 end) const override
+	{
+		begin = qBound<qint64>(0, begin, mTokenizer.size());
+		end = qBound<qint64>(begin, end, mTokenizer.size());
+		return QByteArray(mTokenizer.data() + begin, int(end - begin));
+	}
+
+private:
+	QgsVctTokenizer mTokenizer;
+};
+
+//Name of the span of reading a section, nullptr for lines that do not start one
+static const char *sectionName(QgsVctMarker section)
+{
+	switch (section)
+	{
+	case QgsVctMarker::CommentBegin:
+		return "readComment";
+	case QgsVctMarker::HeadBegin:
+		return "readHead";
+	case QgsVctMarker::FeatureCodeBegin:
+		return "readFeatureCode";
+	case QgsVctMarker::TableStructureBegin:
+		return "readTableStructure";
+	case QgsVctMarker::PointBegin:
+		return "readPoint";
+	case QgsVctMarker::LineBegin:
+		return "readLine";
+	case QgsVctMarker::PolygonBegin:
+		return "readPolygon";
+	case QgsVctMarker::AttributeBegin:
+		return "readAttributes";
+	case QgsVctMarker::SolidBegin:
+	case QgsVctMarker::AggregationBegin:
+	case QgsVctMarker::AnnotationBegin:
+	case QgsVctMarker::TopologyBegin:
+	case QgsVctMarker::StyleBegin:
+		return "skipSection";
+	default:
+		return nullptr;
+	}
+}
+
+static int attributeRowCount(const QgsVctAttributeTables &tables)
+{
+	int count = 0;
+	for (const QgsVctAttributeTable &table : tables)
+		count += table.rows.count() + table.ranges.count();
+	return count;
+}
+
+//Storage types of the attribute columns
+static QVector<QVariant::Type> fieldTypes(const QgsFields &fields)
+{
+	QVector<QVariant::Type> types;
+	types.reserve(fields.count());
+	for (int i = 0; i < fields.count(); i++)
+		types.append(fields.at(i).type());
+	return types;
+}
+
+//Bytes of the file consumed by the readers of a background load, reported to its feedback
+class QgsVctLoadProgress
+{
+public:
+	QgsVctLoadProgress(QgsFeedback *feedback, qint64 size)
+		: mFeedback(feedback)
+		, mSize(std::max<qint64>(size, 1))
+	{
+	}
+
+	//! Adds \a bytes read by one of the readers, returns false when the load is canceled
+	bool add(qint64 bytes)
+	{
+		QMutexLocker locker(&mMutex);
+		mBytes += bytes;
+		mFeedback->setProgress(100.0 * double(std::min(mBytes, mSize)) / double(mSize));
+		return !mFeedback->isCanceled();
+	}
+	bool isCanceled() const { return mFeedback->isCanceled(); }
+
+private:
+	QgsFeedback *mFeedback;
+	qint64 mSize;
+	QMutex mMutex;
+	qint64 mBytes = 0;
+};
+
+//Reports the records of one reader to the progress of the load in steps, and stops the reader on cancel
+class QgsVctReaderProgress
+{
+public:
+	QgsVctReaderProgress(vct::LineReader &reader, QgsVctLoadProgress *progress)
+		: mReader(reader)
+		, mProgress(progress)
+		, mReported(reader.pos())
+	{
+	}
+	~QgsVctReaderProgress()
+	{
+		if (mProgress)
+			mProgress->add(mReader.pos() - mReported);
+	}
+
+	//! Called after each record with its end offset
+	void recordRead(qint64 recordEnd)
+	{
+		if (!mProgress || recordEnd - mReported < PROGRESS_STEP)
+			return;
+		const bool canceled = !mProgress->add(recordEnd - mReported);
+		mReported = recordEnd;
+		if (canceled)
+		{
+			//the readers of the core stop at the end of their text, between two records
+			mReader.seek(mReader.size());
+			mReported = mReader.pos();
+		}
+	}
+
+private:
+	vct::LineReader &mReader;
+	QgsVctLoadProgress *mProgress;
+	qint64 mReported;
+};
+
+//Adapts a feature store to the record readers of the VCT core
+class QgsVctStoreSink
+{
+public:
+	QgsVctStoreSink(QgsVctFeatureStore &features, vct::LineReader &reader, QgsVctLoadProgress *progress)
+		: mFeatures(features)
+		, mProgress(reader, progress)
+	{
+	}
+
+	void beginRecord(int id, const vct::Line &featureCode, const vct::Line &graphicCode, vct::GeometryType type, qint64 recordBegin)
+	{
+		const int row = mFeatures.addFeature(id);
+		const vct::Line feature = featureCode.trimmed();
+		const vct::Line graphic = graphicCode.trimmed();
+		mFeatures.setRecordCodes(row, feature.data(), feature.size(), graphic.data(), graphic.size());
+		mFeatures.beginGeometry(row, geometryType(type), recordBegin);
+	}
+	void beginPart() { mFeatures.beginPart(); }
+	void beginRing() { mFeatures.beginRing(); }
+	void addVertex(double x, double y) { mFeatures.addVertex(x, y); }
+	void endRecord(qint64 recordEnd)
+	{
+		mFeatures.endGeometry(recordEnd);
+		mProgress.recordRead(recordEnd);
+	}
+
+private:
+	static QgsWkbTypes::GeometryType geometryType(vct::GeometryType type)
+	{
+		switch (type)
+		{
+		case vct::GeometryType::Point:
+			return QgsWkbTypes::PointGeometry;
+		case vct::GeometryType::Line:
+			return QgsWkbTypes::LineGeometry;
+		case vct::GeometryType::Polygon:
+			return QgsWkbTypes::PolygonGeometry;
+		default:
+			return QgsWkbTypes::UnknownGeometry;
+		}
+	}
+
+	QgsVctFeatureStore &mFeatures;
+	QgsVctReaderProgress mProgress;
+};
+
+namespace
+{
+	//A file in the dataset registry, with the size and modification time its dataset was read at
+	struct QgsVctDatasetEntry
+	{
+		std::weak_ptr<QgsVctDataset> dataset;
+		qint64 size = -1;
+		qint64 modified = -1;
+	};
+
+	QMutex sRegistryMutex;
+	QHash<QString, QgsVctDatasetEntry> sRegistry;
+	//most recently opened first
+	QList<std::shared_ptr<QgsVctDataset>> sRetained;
+
+	//Links and relative paths to one file share its entry
+	QString registryKey(const QString &path)
+	{
+		const QFileInfo info(path);
+		const QString canonical = info.canonicalFilePath();
+		return canonical.isEmpty() ? info.absoluteFilePath() : canonical;
+	}
+
+	void setStamp(QgsVctDatasetEntry &entry, const QString &key)
+	{
+		const QFileInfo info(key);
+		entry.size = info.exists() ? info.size() : -1;
+		entry.modified = info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+	}
+}
+
+std::shared_ptr<QgsVctDataset> QgsVctDataset::registered(const QString &path)
+{
+	const QString key = registryKey(path);
+	std::shared_ptr<QgsVctDataset> dataset;
+	//destroyed after the registry is unlocked
+	QList<std::shared_ptr<QgsVctDataset>> released;
+	{
+		QMutexLocker locker(&sRegistryMutex);
+		QgsVctDatasetEntry current;
+		setStamp(current, key);
+		const QgsVctDatasetEntry entry = sRegistry.value(key);
+		if (entry.size == current.size && entry.modified == current.modified)
+			dataset = entry.dataset.lock();
+		//a canceled load is started again
+		if (dataset && dataset->mLoadingFeedback.isCanceled())
+			dataset.reset();
+		if (!dataset)
+		{
+			//a file changed on disk gets a new dataset, earlier users keep the old one
+			for (QHash<QString, QgsVctDatasetEntry>::iterator it = sRegistry.begin(); it != sRegistry.end();)
+			{
+				if (it->dataset.expired())
+					it = sRegistry.erase(it);
+				else
+					++it;
+			}
+			dataset.reset(new QgsVctDataset(path));
+			dataset->mKey = key;
+			current.dataset = dataset;
+			sRegistry.insert(key, current);
+		}
+
+		//keep the last files alive without users, for reloaded projects and layers opened again
+		for (int i = 0; i < sRetained.count(); i++)
+		{
+			if (sRetained.at(i) == dataset || sRetained.at(i)->mKey == key)
+				released.append(sRetained.takeAt(i--));
+		}
+		sRetained.prepend(dataset);
+		while (sRetained.count() > RETAINED_DATASETS)
+			released.append(sRetained.takeLast());
+	}
+
+	return dataset;
+}
+
+std::shared_ptr<QgsVctDataset> QgsVctDataset::open(const QString &path)
+{
+	const std::shared_ptr<QgsVctDataset> dataset = registered(path);
+	//users arriving during the parse wait for it instead of parsing again
+	QMutexLocker locker(&dataset->mMutex);
+	if (!dataset->mLoaded && dataset->mLoadStarted)
+	{
+		//the worker takes the lock when it is done
+		QFuture<void> loading = dataset->mLoading;
+		locker.unlock();
+		loading.waitForFinished();
+		locker.relock();
+	}
+	if (!dataset->mLoaded)
+	{
+		dataset->load();
+		dataset->mLoaded = true;
+	}
+	return dataset;
+}
+
+std::shared_ptr<QgsVctDataset> QgsVctDataset::openInBackground(const QString &path)
+{
+	const std::shared_ptr<QgsVctDataset> dataset = registered(path);
+	QMutexLocker locker(&dataset->mMutex);
+	if (!dataset->mLoaded && !dataset->mLoadStarted)
+	{
+		dataset->readSchema();
+		dataset->mLoadStarted = true;
+		dataset->mLoading = QtConcurrent::run([dataset]()
+		{
+			dataset->loadInBackground();
+		});
+	}
+	return dataset;
+}
+
+void QgsVctDataset::releaseAll()
+{
+	QList<std::shared_ptr<QgsVctDataset>> retained;
+	{
+		QMutexLocker locker(&sRegistryMutex);
+		retained = sRetained;
+		sRetained.clear();
+		//loads still running are not waited for at exit
+		for (const QgsVctDatasetEntry &entry : qAsConst(sRegistry))
+		{
+			if (const std::shared_ptr<QgsVctDataset> dataset = entry.dataset.lock())
+				dataset->mLoadingFeedback.cancel();
+		}
+		sRegistry.clear();
+	}
+}
+
+QgsVctDataset::QgsVctDataset(const QString &path)
+	: mPath(path)
+{
+}
+
+QString QgsVctDataset::error() const
+{
+	QMutexLocker locker(&mMutex);
+	return mError;
+}
+
+QStringList QgsVctDataset::comments() const
+{
+	QMutexLocker locker(&mMutex);
+	return mComments;
+}
+
+QFuture<void> QgsVctDataset::loading() const
+{
+	QMutexLocker locker(&mMutex);
+	return mLoading;
+}
+
+int QgsVctDataset::layerIndex(const QString &name) const
+{
+	if (name.isEmpty())
+		return mLayerNames.isEmpty() ? -1 : 0;
+	return mLayerNames.indexOf(name.trimmed());
+}
+
+QgsVctLayerContent QgsVctDataset::layer(int index) const
+{
+	QMutexLocker locker(&mMutex);
+	return mLayers.at(index);
+}
+
+QString QgsVctDataset::journalName(int index) const
+{
+	return mLayerNames.count() > 1 ? mLayerNames.at(index) : QString();
+}
+
+bool QgsVctDataset::claimLayer(int index, const QgsVctProvider *editor, int revision)
+{
+	QMutexLocker locker(&mMutex);
+	const QgsVctProvider *current = mEditors.value(index);
+	if (current == editor)
+		return true;
+	if (current || mRevisions.value(index) != revision)
+		return false;
+	mEditors.insert(index, editor);
+	return true;
+}
+
+void QgsVctDataset::releaseLayer(int index, const QgsVctProvider *editor, bool unsaved)
+{
+	QMutexLocker locker(&mMutex);
+	if (mEditors.value(index) != editor)
+		return;
+	mEditors.remove(index);
+	//only providers reading the layer and its journal from now on see these edits
+	if (unsaved)
+		++mRevisions[index];
+}
+
+bool QgsVctDataset::isClaimable(int index, int revision) const
+{
+	QMutexLocker locker(&mMutex);
+	return !mEditors.contains(index) && mRevisions.value(index) == revision;
+}
+
+int QgsVctDataset::layerRevision(int index) const
+{
+	QMutexLocker locker(&mMutex);
+	return mRevisions.value(index);
+}
+
+QgsFeatureId QgsVctDataset::maximumId() const
+{
+	QMutexLocker locker(&mMutex);
+	QgsFeatureId id = 0;
+	for (const QgsVctLayerContent &layer : mLayers)
+		id = std::max(id, layer.features.maximumId());
+	return id;
+}
+
+bool QgsVctDataset::write(int index, const QgsFields &fields, const QgsVctFeatureStore &features, QString &error)
+{
+	QMutexLocker writeLocker(&mWriteMutex);
+	QgsVctTraceSpan span("write", &mProfile);
+	QgsVctFileContent content;
+	{
+		//the copy shares the containers, the file is written without blocking the readers of the dataset
+		QMutexLocker locker(&mMutex);
+		if (!mLoadComplete)
+		{
+			error = mError.isEmpty() ? QObject::tr("VCT file %1 is not loaded completely").arg(mPath) : mError;
+			return false;
+		}
+		content.path = mPath;
+		content.head = mHead;
+		content.customItems = mCustomItems;
+		content.layers = mLayers;
+	}
+	content.layers[index].fields = fields;
+	content.layers[index].features = features;
+
+	//the journals of the other layers apply to records that are written back unchanged
+	QVector<int> journals;
+	for (int i = 0; i < mLayerNames.count(); i++)
+	{
+		if (i != index && QgsVctJournal(mPath, journalName(i)).matchesFile())
+			journals.append(i);
+	}
+
+	if (!QgsVctWriter::writeFile(content, error, &mProfile))
+		return false;
+	//the lazy records were copied into the written file, one decoder maps it for all layers
+	std::shared_ptr<QgsVctFileDecoder> decoder;
+	for (QgsVctLayerContent &layer : content.layers)
+	{
+		if (!layer.features.hasLazyGeometries() && !layer.features.hasDeferredAttributes())
+			continue;
+		if (!decoder)
+			decoder = std::make_shared<QgsVctFileDecoder>(mPath);
+		layer.features.replaceFile(decoder);
+	}
+	mProfile.add(QgsVctProfile::BytesWritten, QFileInfo(mPath).size());
+	{
+		//the written file is this dataset, later opens share it instead of parsing it again
+		QMutexLocker registryLocker(&sRegistryMutex);
+		const QHash<QString, QgsVctDatasetEntry>::iterator entry = sRegistry.find(mKey);
+		if (entry != sRegistry.end() && entry->dataset.lock().get() == this)
+			setStamp(*entry, mKey);
+	}
+	QMutexLocker locker(&mMutex);
+	for (int i : qAsConst(journals))
+		QgsVctJournal(mPath, journalName(i)).updateSignature();
+	mLayers = content.layers;
+	++mRevisions[index];
+	return true;
+}
+
+void QgsVctDataset::load(QgsFeedback *feedback)
+{
+	QgsVctTraceSpan span("load", &mProfile);
+	QgsVctLoadProgress progress(feedback, QFileInfo(mPath).size());
+	mProgress = feedback ? &progress : nullptr;
+	QgsSettings settings;
+	//out of core, only the record ranges, bounding boxes and codes of the features stay in memory
+	mOutOfCore = settings.value(QStringLiteral("providers/vct/outOfCore"), false).toBool();
+	mLazyGeometries = mOutOfCore || settings.value(QStringLiteral("providers/vct/lazyGeometries"), false).toBool();
+	if (!readCache())
+	{
+		readData();
+		//the layers of a canceled load are discarded
+		if (feedback && feedback->isCanceled())
+		{
+			mProgress = nullptr;
+			return;
+		}
+		writeCache();
+	}
+	mProgress = nullptr;
+	mLoadComplete = mError.isEmpty();
+	if (feedback)
+		feedback->setProgress(100);
+
+	//one decoder maps the file for all layers
+	const qint64 cacheBudget = qint64(settings.value(QStringLiteral("providers/vct/recordCacheSize"), RECORD_CACHE_SIZE).toInt()) * 1024 * 1024;
+	std::shared_ptr<QgsVctFileDecoder> decoder;
+	for (QgsVctLayerContent &layer : mLayers)
+	{
+		mLayerNames.append(layer.featureTypeCode.trimmed());
+		if (!layer.features.hasLazyGeometries() && !layer.features.hasDeferredAttributes())
+			continue;
+		if (!decoder)
+			decoder = std::make_shared<QgsVctFileDecoder>(mPath);
+		layer.features.setDecoder(decoder, cacheBudget);
+	}
+}
+
+void QgsVctDataset::loadInBackground()
+{
+	//read into a dataset of its own, the feature classes of this one stay readable meanwhile
+	QgsVctDataset loaded(mPath);
+	loaded.load(&mLoadingFeedback);
+
+	QMutexLocker locker(&mMutex);
+	mProfile.add(loaded.mProfile);
+	if (mLoadingFeedback.isCanceled())
+		mError = QObject::tr("Loading of VCT file %1 was canceled").arg(mPath);
+	else if (loaded.mLayerNames != mLayerNames)
+		mError = QObject::tr("VCT file %1 changed while it was loaded").arg(mPath);
+	else
+	{
+		mError = loaded.mError;
+		mComments = loaded.mComments;
+		mHead = loaded.mHead;
+		mCustomItems = loaded.mCustomItems;
+		mLayers = loaded.mLayers;
+		mLazyGeometries = loaded.mLazyGeometries;
+		mOutOfCore = loaded.mOutOfCore;
+		mLoadComplete = loaded.mLoadComplete;
+	}
+	mLoaded = true;
+}
+
+void QgsVctDataset::readSchema()
+{
+	QgsVctTraceSpan span("readSchema", &mProfile);
+	QgsVctTokenizer tokenizer(mPath);
+	for (QgsVctLine line = tokenizer.readLine(); !line.isNull(); line = tokenizer.readLine())
+	{
+		const QgsVctMarker section = QgsVctTokenizer::marker(line);
+		//the sections describing the file come before the records
+		if (section == QgsVctMarker::PointBegin || section == QgsVctMarker::LineBegin ||
+			section == QgsVctMarker::PolygonBegin || section == QgsVctMarker::AttributeBegin)
+			break;
+		readSectionContent(section, tokenizer);
+	}
+
+	if (mLayers.isEmpty())
+		mLayers.append(QgsVctLayerContent());
+	for (QgsVctLayerContent &layer : mLayers)
+	{
+		layer.fields = layerFields(layer);
+		mLayerNames.append(layer.featureTypeCode.trimmed());
+	}
+	mTables.clear();
+}
+
+bool QgsVctDataset::readCache()
+{
+	if (!QgsVctCache::isEnabled() || QFileInfo(mPath).size() < CACHE_MINIMUM_SIZE)
+		return false;
+	QgsVctTraceSpan span("readCache", &mProfile);
+	QgsVctCache cache(mPath);
+	if (!cache.open())
+		return false;
+
+	//a cache of the other mode would hold the records in memory, or not have them
+	bool outOfCore = false;
+	QDataStream &stream = cache.stream();
+	stream >> outOfCore;
+	if (stream.status() != QDataStream::Ok || outOfCore != mOutOfCore)
+		return false;
+
+	QStringList comments;
+	QVector<QString> head;
+	QString crs;
+	QVector<QString> customItems;
+	qint32 layerCount = 0;
+	QVector<QgsVctLayerContent> layers;
+
+	stream >> comments >> head >> crs >> customItems >> layerCount;
+	for (qint32 i = 0; i < layerCount && stream.status() == QDataStream::Ok; i++)
+	{
+		QgsVctLayerContent layer;
+		qint32 wkbType = 0;
+		qint32 geometryType = 0;
+		stream >> layer.featureTypeCode >> layer.featureTypeName >> layer.attributeTableName >> wkbType >> geometryType;
+		stream >> layer.fields;
+		if (stream.status() != QDataStream::Ok || !layer.features.readFrom(stream) || layer.features.fieldCount() != layer.fields.count())
+			break;
+		layer.wkbType = static_cast<QgsWkbTypes::Type>(wkbType);
+		layer.geometryType = static_cast<QgsWkbTypes::GeometryType>(geometryType);
+		layers.append(layer);
+	}
+	if (stream.status() != QDataStream::Ok || layers.count() != layerCount || layerCount == 0)
+	{
+		QgsDebugMsg(QStringLiteral("Ignoring invalid VCT cache %1").arg(cache.path()));
+		return false;
+	}
+
+	mComments = comments;
+	mHead = head;
+	if (!crs.isEmpty())
+		mCrs.createFromWkt(crs);
+	mCustomItems = customItems;
+	mLayers = layers;
+	mProfile.add(QgsVctProfile::BytesRead, QFileInfo(cache.path()).size());
+	for (const QgsVctLayerContent &layer : qAsConst(mLayers))
+		mProfile.add(QgsVctProfile::Features, layer.features.count());
+	return true;
+}
+
+void QgsVctDataset::writeCache() const
+{
+	if (!QgsVctCache::isEnabled() || !mError.isEmpty() || QFileInfo(mPath).size() < CACHE_MINIMUM_SIZE)
+		return;
+	QgsVctTraceSpan span("writeCache", &mProfile);
+	QgsVctCache cache(mPath);
+	if (!cache.create())
+		return;
+
+	QDataStream &stream = cache.stream();
+	stream << mOutOfCore;
+	stream << mComments << mHead << (mCrs.isValid() ? mCrs.toWkt() : QString()) << mCustomItems << qint32(mLayers.count());
+	for (const QgsVctLayerContent &layer : mLayers)
+	{
+		stream << layer.featureTypeCode << layer.featureTypeName << layer.attributeTableName << qint32(layer.wkbType) << qint32(layer.geometryType);
+		stream << layer.fields;
+		layer.features.writeTo(stream);
+	}
+	if (!cache.commit())
+		QgsDebugMsg(QStringLiteral("Could not write VCT cache %1").arg(cache.path()));
+}
+
+void QgsVctDataset::readData()
+{
+	QgsVctTraceSpan span("readData", &mProfile);
+	QgsVctTokenizer tokenizer(mPath);
+	if (!tokenizer.isValid())
+	{
+		mError = QObject::tr("Could not open VCT file %1").arg(mPath);
+		buildLayers();
+		return;
+	}
+	if (tokenizer.size() >= PARALLEL_READ_THRESHOLD && QThread::idealThreadCount() > 1 &&
+		QgsSettings().value(QStringLiteral("providers/vct/parallelLoading"), true).toBool())
+	{
+		readDataParallel(tokenizer);
+	}
+	else
+	{
+		mRecords.setLazyGeometries(mLazyGeometries);
+		for (QgsVctLine line = tokenizer.readLine(); !line.isNull(); line = tokenizer.readLine())
+		{
+			readSection(QgsVctTokenizer::marker(line), tokenizer);
+		}
+		buildLayers();
+	}
+	mProfile.add(QgsVctProfile::BytesRead, tokenizer.size());
+	mProfile.add(QgsVctProfile::Lines, tokenizer.lineCount());
+}
+
+void QgsVctDataset::readSection(QgsVctMarker section, QgsVctTokenizer &tokenizer)
+{
+	const char *name = sectionName(section);
+	if (!name)
+		return;
+	QgsVctTraceSpan span(name, &mProfile);
+	const int features = mRecords.count();
+	const int vertices = mRecords.vertexCount();
+	const int attributeRows = attributeRowCount(mAttributeTables);
+	readSectionContent(section, tokenizer);
+	mProfile.add(QgsVctProfile::Features, mRecords.count() - features);
+	mProfile.add(QgsVctProfile::Vertices, mRecords.vertexCount() - vertices);
+	mProfile.add(QgsVctProfile::AttributeRows, attributeRowCount(mAttributeTables) - attributeRows);
+}
+
+void QgsVctDataset::readSectionContent(QgsVctMarker section, QgsVctTokenizer &tokenizer)
+{
+	switch (section)
+	{
+	case QgsVctMarker::CommentBegin:
+		readComment(tokenizer);
+		break;
+	case QgsVctMarker::HeadBegin:
+		readHead(tokenizer);
+		break;
+	case QgsVctMarker::FeatureCodeBegin:
+		readFeatureCode(tokenizer);
+		break;
+	case QgsVctMarker::TableStructureBegin:
+		readTableStructure(tokenizer);
+		break;
+	case QgsVctMarker::PointBegin:
+		readPoint(tokenizer, mRecords, mProgress);
+		break;
+	case QgsVctMarker::LineBegin:
+		readLine(tokenizer, mRecords, mProgress);
+		break;
+	case QgsVctMarker::PolygonBegin:
+		readPolygon(tokenizer, mRecords, mProgress);
+		break;
+	case QgsVctMarker::AttributeBegin:
+		readAttributeRows(tokenizer, true, QString(), tableTypes(), mOutOfCore, mAttributeTables, mProgress);
+		break;
+	case QgsVctMarker::SolidBegin:
+	case QgsVctMarker::AggregationBegin:
+	case QgsVctMarker::AnnotationBegin:
+	case QgsVctMarker::TopologyBegin:
+	case QgsVctMarker::StyleBegin:
+		vct::skipSection(tokenizer.reader(), vct::endMarker(section));
+		break;
+	default:
+		break;
+	}
+}
+
+namespace
+{
+	//A chunk of a record section and what a worker thread parsed from it
+	struct QgsVctChunkJob
+	{
+		QgsVctChunk chunk;
+		QgsVctFeatureStore features;
+		QgsVctAttributeTables attributes;
+	};
+}
+
+void QgsVctDataset::readDataParallel(QgsVctTokenizer &tokenizer)
+{
+	const qint64 chunkSize = std::max<qint64>(PARALLEL_READ_CHUNK_SIZE, tokenizer.size() / (QThread::idealThreadCount() * 4));
+	const QList<QgsVctChunk> chunks = tokenizer.scanChunks(chunkSize);
+
+	//head, feature codes and table structures are small, read them in place
+	QVector<QgsVctChunkJob> jobs;
+	for (const QgsVctChunk &chunk : chunks)
+	{
+		switch (chunk.section)
+		{
+		case QgsVctMarker::PointBegin:
+		case QgsVctMarker::LineBegin:
+		case QgsVctMarker::PolygonBegin:
+		case QgsVctMarker::AttributeBegin:
+		{
+			QgsVctChunkJob job;
+			job.chunk = chunk;
+			jobs.append(job);
+			break;
+		}
+		case QgsVctMarker::CommentBegin:
+		case QgsVctMarker::HeadBegin:
+		case QgsVctMarker::FeatureCodeBegin:
+		case QgsVctMarker::TableStructureBegin:
+			tokenizer.seek(chunk.begin);
+			readSection(chunk.section, tokenizer);
+			break;
+		default:
+			break;
+		}
+	}
+
+	const QgsVctTokenizer *source = &tokenizer;
+	const bool lazy = mLazyGeometries;
+	const bool deferred = mOutOfCore;
+	const QHash<QString, QVector<QVariant::Type>> types = tableTypes();
+	QgsVctProfile *profile = &mProfile;
+	QgsVctLoadProgress *progress = mProgress;
+	QtConcurrent::blockingMap(jobs, [source, lazy, deferred, &types, profile, progress](QgsVctChunkJob &job)
+	{
+		if (progress && progress->isCanceled())
+			return;
+		QgsVctTraceSpan span(sectionName(job.chunk.section), profile);
+		QgsVctTokenizer chunkTokenizer(*source, job.chunk.begin, job.chunk.end);
+		job.features.setLazyGeometries(lazy);
+		switch (job.chunk.section)
+		{
+		case QgsVctMarker::PointBegin:
+			readPoint(chunkTokenizer, job.features, progress);
+			break;
+		case QgsVctMarker::LineBegin:
+			readLine(chunkTokenizer, job.features, progress);
+			break;
+		case QgsVctMarker::PolygonBegin:
+			readPolygon(chunkTokenizer, job.features, progress);
+			break;
+		case QgsVctMarker::AttributeBegin:
+			readAttributeRows(chunkTokenizer, !job.chunk.continuation, job.chunk.table, types, deferred, job.attributes, progress);
+			break;
+		default:
+			break;
+		}
+	});
+
+	//merge in file order, so that a later record wins like in a sequential read
+	for (const QgsVctChunkJob &job : qAsConst(jobs))
+	{
+		mProfile.add(QgsVctProfile::Features, job.features.count());
+		mProfile.add(QgsVctProfile::Vertices, job.features.vertexCount());
+		mProfile.add(QgsVctProfile::AttributeRows, attributeRowCount(job.attributes));
+		mRecords.append(job.features);
+		mAttributeTables += job.attributes;
+	}
+	buildLayers();
+}
+
+void QgsVctDataset::buildLayers()
+{
+	QgsVctTraceSpan span("buildLayers", &mProfile);
+	if (mLayers.isEmpty())
+	{
+		//a file without feature classes is read as one layer without geometry type
+		mLayers.append(QgsVctLayerContent());
+	}
+
+	//records go to the class of their feature code, or else to the first class of their geometry type
+	QHash<QByteArray, int> layerOfCode;
+	QHash<int, int> layerOfType;
+	QHash<QString, int> layerOfTable;
+	for (int i = mLayers.count() - 1; i >= 0; i--)
+	{
+		const QgsVctLayerContent &layer = mLayers.at(i);
+		layerOfCode.insert(layer.featureTypeCode.trimmed().toUtf8(), i);
+		layerOfType.insert(layer.geometryType, i);
+		layerOfTable.insert(layer.attributeTableName.trimmed(), i);
+	}
+	QVector<int> parts(mRecords.count());
+	for (int row = 0; row < mRecords.count(); row++)
+	{
+		const int layer = layerOfCode.value(mRecords.featureCode(row), -1);
+		parts[row] = layer >= 0 ? layer : layerOfType.value(mRecords.geometryType(row), 0);
+	}
+	const QVector<QgsVctFeatureStore> stores = mRecords.partition(parts, mLayers.count());
+	mRecords = QgsVctFeatureStore();
+
+	for (int i = 0; i < mLayers.count(); i++)
+	{
+		QgsVctLayerContent &layer = mLayers[i];
+		layer.fields = layerFields(layer);
+		layer.features = stores.at(i);
+		layer.features.normalize();
+	}
+
+	for (const QgsVctAttributeTable &table : qAsConst(mAttributeTables))
+	{
+		const int layer = layerOfTable.value(table.name, mLayers.count() == 1 ? 0 : -1);
+		if (layer < 0)
+		{
+			QgsDebugMsg(QStringLiteral("Ignoring attribute table %1 of %2 without feature class").arg(table.name, mPath));
+			continue;
+		}
+		applyAttributeRows(mLayers[layer], table);
+	}
+	mAttributeTables.clear();
+	mTables.clear();
+
+	for (QgsVctLayerContent &layer : mLayers)
+	{
+		layer.features.setFieldTypes(fieldTypes(layer.fields));
+		layer.features.encodeStrings();
+	}
+}
+
+QgsFields QgsVctDataset::layerFields(const QgsVctLayerContent &layer) const
+{
+	const QString table = layer.attributeTableName.trimmed();
+	if (mTables.contains(table))
+		return mTables.value(table);
+	else if (mTables.count() == 1)
+		return mTables.constBegin().value();
+	return layer.fields;
+}
+
+QHash<QString, QVector<QVariant::Type>> QgsVctDataset::tableTypes() const
+{
+	QHash<QString, QVector<QVariant::Type>> types;
+	for (QHash<QString, QgsFields>::const_iterator it = mTables.constBegin(); it != mTables.constEnd(); ++it)
+		types.insert(it.key(), fieldTypes(it.value()));
+	//rows of a table without structure are converted when they are assigned to a layer
+	if (mTables.count() == 1)
+		types.insert(QString(), fieldTypes(mTables.constBegin().value()));
+	return types;
+}
+
+void QgsVctDataset::readComment(QgsVctTokenizer &tokenizer)
+{
+	mComments.append(QString::fromStdString(vct::readComment(tokenizer.reader())));
+}
+
+void QgsVctDataset::readHead(QgsVctTokenizer &tokenizer)
+{
+	std::vector<std::string> head;
+	vct::readHead(tokenizer.reader(), head);
+	for (const std::string &line : head)
+	{
+		QString extra = QString::fromStdString(line);
+		int colon = extra.indexOf(':');
+		QString key = extra.left(colon);
+		QString value = colon < 0 ? QString() : extra.mid(colon + 1);
+		mHead.append(extra);
+		if (key.contains("Spheroid"))
+		{
+			QStringList values = value.split(',');
+			//QgsMessageLog::logMessage("spheroidValues[0]: " + values[0], "vct", Qgis::Critical, true);
+			if (values[0].contains("中国2000国家大地"))
+			{
+				mCrs = QgsCoordinateReferenceSystem(QStringLiteral("EPSG:4526"));
+			}
+			else if (values[0].contains("克拉索夫斯基(1940)"))
+				mCrs = QgsCoordinateReferenceSystem(QStringLiteral("EPSG:4024"));
+		}
+	}
+}
+
+void QgsVctDataset::readFeatureCode(QgsVctTokenizer &tokenizer)
+{
+	std::vector<vct::FeatureClass> classes;
+	std::vector<std::string> customItems;
+	vct::readFeatureCodes(tokenizer.reader(), classes, customItems);
+	for (const vct::FeatureClass &featureClass : classes)
+	{
+		QgsVctLayerContent layer;
+		layer.featureTypeCode = QString::fromStdString(featureClass.code);
+		layer.featureTypeName = QString::fromStdString(featureClass.name);
+		layer.attributeTableName = QString::fromStdString(featureClass.table);
+		switch (featureClass.geometryType)
+		{
+		case vct::GeometryType::Point:
+			layer.wkbType = QgsWkbTypes::MultiPoint;
+			layer.geometryType = QgsWkbTypes::PointGeometry;
+			break;
+		case vct::GeometryType::Line:
+			layer.wkbType = QgsWkbTypes::MultiLineString;
+			layer.geometryType = QgsWkbTypes::LineGeometry;
+			break;
+		default:
+			layer.wkbType = QgsWkbTypes::MultiPolygon;
+			layer.geometryType = QgsWkbTypes::PolygonGeometry;
+			break;
+		}
+		mLayers.append(layer);
+	}
+	//略过用户项
+	for (const std::string &item : customItems)
+		mCustomItems.append(QString::fromStdString(item));
+}
+
+void QgsVctDataset::readTableStructure(QgsVctTokenizer &tokenizer)
+{
+	std::vector<vct::TableStructure> tables;
+	vct::readTableStructures(tokenizer.reader(), tables);
+	for (const vct::TableStructure &table : tables)
+	{
+		QgsFields fields;
+		for (const vct::Field &tableField : table.fields)
+		{
+			const QString field = QString::fromStdString(tableField.name);
+			const QString type = QString::fromStdString(tableField.type);
+			//the declared type name is kept, it is written back as read
+			if (type == "Double" || type == "Float")
+				fields.append(QgsField(field, QVariant::Double, type, tableField.length, tableField.precision));
+			else if (type == "Int8")
+				fields.append(QgsField(field, QVariant::LongLong, type, tableField.length, tableField.precision));
+			else if (type.contains("Int"))
+				fields.append(QgsField(field, QVariant::Int, type, tableField.length, tableField.precision));
+			else
+				fields.append(QgsField(field, QVariant::String, type, tableField.length, tableField.precision));
+		}
+		mTables.insert(QString::fromStdString(table.name), fields);
+	}
+}
+
+void QgsVctDataset::readPoint(QgsVctTokenizer &tokenizer, QgsVctFeatureStore &features, QgsVctLoadProgress *progress)
+{
+	QgsVctStoreSink sink(features, tokenizer.reader(), progress);
+	vct::readPoints(tokenizer.reader(), sink);
+}
+
+void QgsVctDataset::readLine(QgsVctTokenizer &tokenizer, QgsVctFeatureStore &features, QgsVctLoadProgress *progress)
+{
+	QgsVctStoreSink sink(features, tokenizer.reader(), progress);
+	vct::readLines(tokenizer.reader(), sink);
+}
+
+void QgsVctDataset::readPolygon(QgsVctTokenizer &tokenizer, QgsVctFeatureStore &features, QgsVctLoadProgress *progress)
+{
+	QgsVctStoreSink sink(features, tokenizer.reader(), progress);
+	vct::readPolygons(tokenizer.reader(), sink);
+}
+
+//Value of an attribute field in the type of its column, text that does not convert is left to the store
+static QVariant attributeValue(const QgsVctLine &field, QVariant::Type type)
+{
+	bool ok = false;
+	switch (type)
+	{
+	case QVariant::Int:
+	{
+		const int value = field.toInt(&ok);
+		if (ok)
+			return value;
+		break;
+	}
+	case QVariant::Double:
+	{
+		const double value = field.toDouble(&ok);
+		if (ok)
+			return value;
+		break;
+	}
+	default:
+		break;
+	}
+
+	const QString text = field.toString();
+	QVariant value = text;
+	if (!QgsVctFeatureStore::convertValue(value, type))
+		return text;
+	return value;
+}
+
+//Collects the rows of the attribute reader of the VCT core, converted or as byte ranges
+class QgsVctAttributeSink
+{
+public:
+	QgsVctAttributeSink(const QHash<QString, QVector<QVariant::Type>> &types, bool deferred, QgsVctAttributeTables &tables,
+		vct::LineReader &reader, QgsVctLoadProgress *progress)
+		: mTypes(types)
+		, mDeferred(deferred)
+		, mTables(tables)
+		, mProgress(reader, progress)
+	{
+	}
+
+	void beginTable(const QString &name)
+	{
+		mTables.append(QgsVctAttributeTable{ name, QgsVctAttributeRows(), QgsVctAttributeRanges() });
+		mRowTypes = mTypes.value(name, mTypes.value(QString()));
+	}
+	void beginTable(const vct::Line &name) { beginTable(QgsVctLine(name).toString()); }
+
+	void addRow(int id, const vct::Line &line, qint64 begin, qint64 end)
+	{
+		mProgress.recordRead(end);
+		if (mDeferred)
+		{
+			mTables.last().ranges.append(QgsVctAttributeRange{ id, begin, end });
+			return;
+		}
+		int pos = 0;
+		QgsVctLine field;
+		line.nextField(',', pos, field);
+		QgsVctAttributeRow row;
+		row.first = id;
+		while (line.nextField(',', pos, field))
+		{
+			row.second.append(attributeValue(field, mRowTypes.value(row.second.count(), QVariant::String)));
+		}
+		mTables.last().rows.append(row);
+	}
+
+private:
+	const QHash<QString, QVector<QVariant::Type>> &mTypes;
+	bool mDeferred;
+	QgsVctAttributeTables &mTables;
+	QVector<QVariant::Type> mRowTypes;
+	QgsVctReaderProgress mProgress;
+};
+
+void QgsVctDataset::readAttributeRows(QgsVctTokenizer &tokenizer, bool startsWithTableName, const QString &table,
+	const QHash<QString, QVector<QVariant::Type>> &types, bool deferred, QgsVctAttributeTables &tables,
+	QgsVctLoadProgress *progress)
+{
+	QgsVctAttributeSink sink(types, deferred, tables, tokenizer.reader(), progress);
+	//a chunk continuing the table started before it
+	if (!startsWithTableName)
+		sink.beginTable(table);
+	vct::readAttributeRows(tokenizer.reader(), startsWithTableName, sink);
+}
+
+void QgsVctDataset::applyAttributeRows(QgsVctLayerContent &layer, const QgsVctAttributeTable &table)
+{
+	QgsVctFeatureStore &features = layer.features;
+	features.normalize();
+	features.setFieldTypes(fieldTypes(layer.fields));
+
+	//a row without a geometry record still makes a feature
+	bool added = false;
+	for (const QgsVctAttributeRow &row : table.rows)
+	{
+		if (!features.contains(row.first))
+		{
+			features.addFeature(row.first);
+			added = true;
+		}
+	}
+	for (const QgsVctAttributeRange &range : table.ranges)
+	{
+		if (!features.contains(range.id))
+		{
+			features.addFeature(range.id);
+			added = true;
+		}
+	}
+	if (added)
+		features.normalize();
+
+	for (const QgsVctAttributeRow &row : table.rows)
+	{
+		features.setAttributes(features.row(row.first), row.second);
+	}
+	for (const QgsVctAttributeRange &range : table.ranges)
+	{
+		features.deferAttributes(features.row(range.id), range.begin, range.end);
+	}
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "qgscoordinatereferencesystem.h"
+#include "qgsfeedback.h"
+#include "qgsvcttrace.h"
+#include "qgsvctwriter.h"
+
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QStringList>
+
+#include <memory>
+
+class QgsVctTokenizer;
+class QgsVctLoadProgress;
+class QgsVctProvider;
+namespace vct { enum class Marker; }
+typedef vct::Marker QgsVctMarker;
+
+typedef QPair<QgsFeatureId, QgsAttributes> QgsVctAttributeRow;
+typedef QVector<QgsVctAttributeRow> QgsVctAttributeRows;
+
+//Attribute row left in the file, by its byte range
+struct QgsVctAttributeRange
+{
+	QgsFeatureId id;
+	qint64 begin;
+	qint64 end;
+};
+typedef QVector<QgsVctAttributeRange> QgsVctAttributeRanges;
+
+//Rows of one attribute table, in file order, read or deferred
+struct QgsVctAttributeTable
+{
+	QString name;
+	QgsVctAttributeRows rows;
+	QgsVctAttributeRanges ranges;
+};
+typedef QVector<QgsVctAttributeTable> QgsVctAttributeTables;
+
+/**
+ * Parsed content of a VCT file, shared by the providers of all its feature classes.
+ *
+ * The feature code section declares the classes of a file and the table structure section their
+ * attribute tables, while the records of all classes of a geometry type share one section. Each
+ * class becomes a layer with its own feature store: records go to the class of their feature code,
+ * attribute rows to the class of their table.
+ *
+ * open() parses a file once and hands the same dataset to every provider that opens one of its
+ * layers, as long as the file keeps the size and modification time it was read at. Datasets are
+ * released with their last user, except for the most recently opened ones, which are kept for
+ * layers that are opened again. Providers copy the store of their layer, which shares its
+ * containers until the provider edits them, and save through write(), which writes the whole
+ * file with the other layers as they were last saved.
+ *
+ * openInBackground() returns as soon as the feature classes are known and parses the records on a
+ * worker thread. Until then the layers have their fields but no features.
+ */
+class QgsVctDataset
+{
+public:
+
+	//! Parsed content of \a path, shared with the other users of the file
+	static std::shared_ptr<QgsVctDataset> open(const QString &path);
+	/**
+	 * Like open(), but only the sections describing the file are read before it returns, the records
+	 * are read on a worker thread. loadingFeedback() reports the progress and cancels the load, which
+	 * leaves the layers without features and sets error().
+	 */
+	static std::shared_ptr<QgsVctDataset> openInBackground(const QString &path);
+	//! Forgets all datasets, those still in use are released with their last user
+	static void releaseAll();
+
+	QString path() const { return mPath; }
+	//! Why the file could not be read, empty on success
+	QString error() const;
+	QStringList comments() const;
+	QgsCoordinateReferenceSystem crs() const { return mCrs; }
+
+	int layerCount() const { return mLayerNames.count(); }
+	//! Feature code of every layer, the name used in "path|layername=CODE" data sources
+	QStringList layerNames() const { return mLayerNames; }
+	//! Index of the layer named \a name, the first layer for an empty name and -1 if there is none
+	int layerIndex(const QString &name) const;
+	//! Layer \a index as it was read or last saved
+	QgsVctLayerContent layer(int index) const;
+	//! Name of the edit journal of a layer, empty when the file has a single layer
+	QString journalName(int index) const;
+
+	/**
+	 * Providers of a layer that is opened twice share its journal, so only one of them saves edits.
+	 * claimLayer() makes \a editor that provider, unless another one is or the layer changed since
+	 * \a editor read it at \a revision. releaseLayer() frees the layer, \a unsaved tells that the
+	 * journal holds edits the other providers did not read.
+	 */
+	bool claimLayer(int index, const QgsVctProvider *editor, int revision);
+	void releaseLayer(int index, const QgsVctProvider *editor, bool unsaved);
+	//! Whether claimLayer() would succeed for a provider that is not the editor
+	bool isClaimable(int index, int revision) const;
+	//! Number of saves of layer \a index, read it before layer()
+	int layerRevision(int index) const;
+	//! Largest feature id over all layers
+	QgsFeatureId maximumId() const;
+	//! Time spent loading and saving the file, per section, and what was read and written
+	const QgsVctProfile &profile() const { return mProfile; }
+	//! Load running on a worker thread, finished once the records are read
+	QFuture<void> loading() const;
+	//! Progress of the load in percent of the file, shared by the layers of the file
+	QgsFeedback *loadingFeedback() const { return &mLoadingFeedback; }
+
+	/**
+	 * Writes the file with layer \a index replaced by \a fields and \a features, which become the saved
+	 * state of the layer. Edit journals of the other layers stay valid. Can run on any thread, the other
+	 * users of the dataset only wait for the layers to be copied before and installed after the write.
+	 */
+	bool write(int index, const QgsFields &fields, const QgsVctFeatureStore &features, QString &error);
+
+private:
+
+	explicit QgsVctDataset(const QString &path);
+
+	//! Registered dataset of \a path, created when the file is new or has changed
+	static std::shared_ptr<QgsVctDataset> registered(const QString &path);
+	void load(QgsFeedback *feedback = nullptr);
+	//! Reads the file into a dataset of its own and takes over its layers, on a worker thread
+	void loadInBackground();
+	//! Reads the feature classes and table structures, up to the first record section
+	void readSchema();
+	bool readCache();
+	void writeCache() const;
+	void readData();
+	void readDataParallel(QgsVctTokenizer &tokenizer);
+	//! Reads a section and adds its time and counts to the profile
+	void readSection(QgsVctMarker section, QgsVctTokenizer &tokenizer);
+	void readSectionContent(QgsVctMarker section, QgsVctTokenizer &tokenizer);
+	void readComment(QgsVctTokenizer &tokenizer);
+	void readHead(QgsVctTokenizer &tokenizer);
+	void readFeatureCode(QgsVctTokenizer &tokenizer);
+	void readTableStructure(QgsVctTokenizer &tokenizer);
+	static void readPoint(QgsVctTokenizer &tokenizer, QgsVctFeatureStore &features, QgsVctLoadProgress *progress = nullptr);
+	static void readLine(QgsVctTokenizer &tokenizer, QgsVctFeatureStore &features, QgsVctLoadProgress *progress = nullptr);
+	static void readPolygon(QgsVctTokenizer &tokenizer, QgsVctFeatureStore &features, QgsVctLoadProgress *progress = nullptr);
+	static void readAttributeRows(QgsVctTokenizer &tokenizer, bool startsWithTableName, const QString &table,
+		const QHash<QString, QVector<QVariant::Type>> &types, bool deferred, QgsVctAttributeTables &tables,
+		QgsVctLoadProgress *progress = nullptr);
+	static void applyAttributeRows(QgsVctLayerContent &layer, const QgsVctAttributeTable &table);
+	//! Distributes the records and attribute rows read from the file to the layers
+	void buildLayers();
+	//! Fields of the attribute table of \a layer
+	QgsFields layerFields(const QgsVctLayerContent &layer) const;
+	QHash<QString, QVector<QVariant::Type>> tableTypes() const;
+
+	QString mPath;
+	//canonical path in the registry
+	QString mKey;
+	QString mError;
+	bool mLoaded = false;
+	//the records of every layer were read, a failed or canceled load is never written back
+	bool mLoadComplete = false;
+	bool mLazyGeometries = false;
+	bool mOutOfCore = false;
+	bool mLoadStarted = false;
+	QFuture<void> mLoading;
+	mutable QgsFeedback mLoadingFeedback;
+	//progress of the running load, nullptr when nobody follows it
+	QgsVctLoadProgress *mProgress = nullptr;
+
+	//guards the layers against concurrent saves, and the first load
+	mutable QMutex mMutex;
+	//saves follow each other, each one writes the layers saved by the previous one
+	QMutex mWriteMutex;
+	mutable QgsVctProfile mProfile;
+
+	QStringList mComments;
+	QVector<QString> mHead;
+	QgsCoordinateReferenceSystem mCrs;
+	QVector<QString> mCustomItems;
+	QVector<QgsVctLayerContent> mLayers;
+	QStringList mLayerNames;
+	//provider saving the edits of each layer, and the revision of the layers
+	QHash<int, const QgsVctProvider *> mEditors;
+	QHash<int, int> mRevisions;
+
+	//parse state, released by buildLayers()
+	QgsVctFeatureStore mRecords;
+	QHash<QString, QgsFields> mTables;
+	QgsVctAttributeTables mAttributeTables;
+
+	friend class QgsVctFileDecoder;
+};
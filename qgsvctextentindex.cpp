@@ -0,0 +1,161 @@
+#include "qgsvctextentindex.h"
+
+#include <algorithm>
+
+namespace
+{
+	inline QgsRectangle emptyBox()
+	{
+		QgsRectangle box;
+		box.setMinimal();
+		return box;
+	}
+
+	inline bool isEmptyBox(const QgsRectangle &box)
+	{
+		return box.xMinimum() > box.xMaximum();
+	}
+
+	//QgsRectangle::combineExtentWith() takes a box at the origin for a null one
+	inline void unite(QgsRectangle &target, const QgsRectangle &box)
+	{
+		target.setXMinimum(std::min(target.xMinimum(), box.xMinimum()));
+		target.setYMinimum(std::min(target.yMinimum(), box.yMinimum()));
+		target.setXMaximum(std::max(target.xMaximum(), box.xMaximum()));
+		target.setYMaximum(std::max(target.yMaximum(), box.yMaximum()));
+	}
+}
+
+void QgsVctExtentIndex::clear()
+{
+	mValid = false;
+	mIds.clear();
+	mLevels.clear();
+	mEmptySlots = 0;
+}
+
+qint64 QgsVctExtentIndex::memoryUsage() const
+{
+	qint64 bytes = qint64(mIds.capacity()) * qint64(sizeof(QgsFeatureId));
+	for (const QVector<QgsRectangle> &level : mLevels)
+		bytes += qint64(level.capacity()) * qint64(sizeof(QgsRectangle));
+	return bytes;
+}
+
+void QgsVctExtentIndex::build(const QVector<QgsFeatureId> &ids, const QVector<QgsRectangle> &boxes)
+{
+	mIds = ids;
+	mLevels.clear();
+	mLevels.append(boxes);
+	mEmptySlots = 0;
+	buildLevels();
+	mValid = true;
+}
+
+void QgsVctExtentIndex::buildLevels()
+{
+	mLevels.resize(1);
+	while (mLevels.last().count() > 1)
+	{
+		const QVector<QgsRectangle> children = mLevels.last();
+		QVector<QgsRectangle> parents((children.count() + FAN_OUT - 1) / FAN_OUT, emptyBox());
+		for (int child = 0; child < children.count(); child++)
+			unite(parents[child / FAN_OUT], children.at(child));
+		mLevels.append(parents);
+	}
+}
+
+int QgsVctExtentIndex::slot(QgsFeatureId id) const
+{
+	const QVector<QgsFeatureId>::const_iterator it = std::lower_bound(mIds.constBegin(), mIds.constEnd(), id);
+	if (it == mIds.constEnd() || *it != id)
+		return -1;
+	return int(it - mIds.constBegin());
+}
+
+void QgsVctExtentIndex::updatePath(int slot)
+{
+	int index = slot;
+	for (int level = 0; mLevels.at(level).count() > 1; level++)
+	{
+		if (level + 1 == mLevels.count())
+			mLevels.append(QVector<QgsRectangle>());
+		const int parent = index / FAN_OUT;
+		QVector<QgsRectangle> &parents = mLevels[level + 1];
+		if (parents.count() <= parent)
+			parents.resize(parent + 1);
+
+		const QVector<QgsRectangle> &children = mLevels.at(level);
+		QgsRectangle box = emptyBox();
+		const int end = std::min(children.count(), (parent + 1) * FAN_OUT);
+		for (int child = parent * FAN_OUT; child < end; child++)
+			unite(box, children.at(child));
+		parents[parent] = box;
+		index = parent;
+	}
+}
+
+void QgsVctExtentIndex::setBox(QgsFeatureId id, const QgsRectangle &box)
+{
+	if (!mValid)
+		return;
+
+	int index = slot(id);
+	if (index < 0)
+	{
+		if (!mIds.isEmpty() && id < mIds.last())
+		{
+			//out of order, only when edits reuse ids
+			index = int(std::lower_bound(mIds.constBegin(), mIds.constEnd(), id) - mIds.constBegin());
+			mIds.insert(index, id);
+			mLevels[0].insert(index, box);
+			mEmptySlots += isEmptyBox(box) ? 1 : 0;
+			buildLevels();
+			return;
+		}
+		mIds.append(id);
+		mLevels[0].append(emptyBox());
+		index = mIds.count() - 1;
+		++mEmptySlots;
+	}
+
+	mEmptySlots += (isEmptyBox(box) ? 1 : 0) - (isEmptyBox(mLevels.at(0).at(index)) ? 1 : 0);
+	mLevels[0][index] = box;
+	updatePath(index);
+}
+
+void QgsVctExtentIndex::removeBox(QgsFeatureId id)
+{
+	const int index = mValid ? slot(id) : -1;
+	if (index < 0 || isEmptyBox(mLevels.at(0).at(index)))
+		return;
+
+	mLevels[0][index] = emptyBox();
+	++mEmptySlots;
+	if (mEmptySlots <= mIds.count() / 2)
+	{
+		updatePath(index);
+		return;
+	}
+
+	//drop the empty slots, amortized over the removals that emptied them
+	QVector<QgsFeatureId> ids;
+	QVector<QgsRectangle> boxes;
+	ids.reserve(mIds.count() - mEmptySlots);
+	boxes.reserve(mIds.count() - mEmptySlots);
+	for (int i = 0; i < mIds.count(); i++)
+	{
+		if (isEmptyBox(mLevels.at(0).at(i)))
+			continue;
+		ids.append(mIds.at(i));
+		boxes.append(mLevels.at(0).at(i));
+	}
+	build(ids, boxes);
+}
+
+QgsRectangle QgsVctExtentIndex::extent() const
+{
+	if (mLevels.isEmpty() || mLevels.last().isEmpty())
+		return emptyBox();
+	return mLevels.last().at(0);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "qgsfeature.h"
+#include "qgsrectangle.h"
+
+#include <QVector>
+
+/**
+ * Extent of a changing set of feature bounding boxes.
+ *
+ * Boxes are kept in slots ordered by feature id, under a tree of unions with a fan-out of
+ * FAN_OUT. Adding, moving or removing a box updates one path in O(log n) and the extent is
+ * the root, so removing a feature on the boundary never rescans the others. New features
+ * get ids above all others and append a slot; a smaller new id rebuilds the slots. Slots of
+ * removed features stay empty until they make up half of the slots.
+ */
+class QgsVctExtentIndex
+{
+public:
+
+	//! Whether build() was called since the last clear()
+	bool isValid() const { return mValid; }
+	void clear();
+	//! Estimated bytes held by the slots and the tree
+	qint64 memoryUsage() const;
+	//! Fills the index with \a boxes of the features \a ids, in ascending order
+	void build(const QVector<QgsFeatureId> &ids, const QVector<QgsRectangle> &boxes);
+
+	//! Adds or replaces the box of \a id
+	void setBox(QgsFeatureId id, const QgsRectangle &box);
+	void removeBox(QgsFeatureId id);
+
+	//! Union of all boxes, a minimal rectangle when there is none
+	QgsRectangle extent() const;
+
+private:
+
+	static const int FAN_OUT = 16;
+
+	int slot(QgsFeatureId id) const;
+	void updatePath(int slot);
+	void buildLevels();
+
+	bool mValid = false;
+	QVector<QgsFeatureId> mIds;
+	//the first level holds the box of each slot, every further level the unions of FAN_OUT nodes below
+	QVector<QVector<QgsRectangle>> mLevels;
+	int mEmptySlots = 0;
+};
@@ -2,16 +2,97 @@
 #include "qgsexpressioncontextutils.h"
 #include "qgsproject.h"
 #include "qgsmessagelog.h"
+#include "qgsexception.h"
 
 
 
 QgsVctFeatureIterator::QgsVctFeatureIterator(QgsVctFeatureSource *source, bool ownSource, const QgsFeatureRequest &request)
 	: QgsAbstractFeatureIteratorFromSource<QgsVctFeatureSource>(source, ownSource, request)
+	, mSpan(qgis::make_unique<QgsVctTraceSpan>("iterate", source->mProfile.get()))
 {
 	if (mRequest.destinationCrs().isValid() && mRequest.destinationCrs() != mSource->mCrs)
 	{
 		mTransform = QgsCoordinateTransform(mSource->mCrs, mRequest.destinationCrs(), mRequest.transformContext());
 	}
+	try
+	{
+		mFilterRect = filterRectToSourceCrs(mTransform);
+	}
+	catch (QgsCsException &)
+	{
+		// can't reproject mFilterRect
+		close();
+		return;
+	}
+
+	// prepare spatial filter geometries for optimal speed
+	if (!mFilterRect.isNull() && mRequest.flags() & QgsFeatureRequest::ExactIntersect)
+	{
+		mSelectRectGeom = QgsGeometry::fromRect(mFilterRect);
+		mSelectRectEngine.reset(QgsGeometry::createGeometryEngine(mSelectRectGeom.constGet()));
+		mSelectRectEngine->prepareGeometry();
+	}
+
+	if (mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes)
+	{
+		const QgsAttributeList subset = mRequest.subsetOfAttributes();
+		for (int field : subset)
+		{
+			if (field >= 0 && field < mSource->mFields.count())
+				mAttributeList.append(field);
+		}
+
+		// the filter expression needs its columns even when they are not requested
+		if (mRequest.filterType() == QgsFeatureRequest::FilterExpression)
+		{
+			const QSet<QString> columns = mRequest.filterExpression()->referencedColumns();
+			const bool allColumns = columns.contains(QgsFeatureRequest::ALL_ATTRIBUTES);
+			for (int field = 0; field < mSource->mFields.count(); field++)
+			{
+				if (allColumns && !mAttributeList.contains(field))
+					mFilterAttributeList.append(field);
+			}
+			for (const QString &column : columns)
+			{
+				const int field = mSource->mFields.lookupField(column);
+				if (field >= 0 && !mAttributeList.contains(field) && !mFilterAttributeList.contains(field))
+					mFilterAttributeList.append(field);
+			}
+			if (!mFilterAttributeList.isEmpty())
+			{
+				mEvaluateFilter = true;
+				mRequest.filterExpression()->prepare(mRequest.expressionContext());
+			}
+		}
+	}
+
+	// id filters are direct lookups, the filter rect is still tested on each candidate
+	if (mRequest.filterType() == QgsFeatureRequest::FilterFid)
+	{
+		mUsingFeatureIdList = true;
+		if (mSource->mFeatures.contains(mRequest.filterFid()))
+			mFeatureIdList.append(mRequest.filterFid());
+	}
+	else if (mRequest.filterType() == QgsFeatureRequest::FilterFids)
+	{
+		mUsingFeatureIdList = true;
+		mFeatureIdList = mRequest.filterFids().toList();
+		std::sort(mFeatureIdList.begin(), mFeatureIdList.end());
+	}
+	// if there's spatial index, use it!
+	// (but don't use it when selection rect is not specified)
+	else if (!mFilterRect.isNull() && mSource->mSpatialIndex)
+	{
+		mUsingFeatureIdList = true;
+		mFeatureIdList = mSource->mSpatialIndex->intersects(mFilterRect);
+		//visit the candidates in row order
+		std::sort(mFeatureIdList.begin(), mFeatureIdList.end());
+	}
+	else
+	{
+		mUsingFeatureIdList = false;
+	}
+
 	rewind();
 }
 
@@ -24,7 +105,10 @@ bool QgsVctFeatureIterator::rewind()
 {
 	if (mClosed)
 		return false;
-	mSelectIterator = mSource->mFeatures.constBegin();
+	if (mUsingFeatureIdList)
+		mFeatureIdListIterator = mFeatureIdList.constBegin();
+	else
+		mRow = 0;
 
 	return true;
 }
@@ -34,6 +118,19 @@ bool QgsVctFeatureIterator::close()
 	if (mClosed)
 		return false;
 
+	//close() is also reached from within fetchFeature once the features run out
+	if (mFetching)
+	{
+		mFetchNanoseconds += mFetchTimer.nsecsElapsed();
+		mFetching = false;
+	}
+	if (mSource->mProfile)
+	{
+		mSource->mProfile->addSpan("fetchFeature", mFetchNanoseconds);
+		mSource->mProfile->add(QgsVctProfile::Features, mFetched);
+	}
+	mSpan.reset();
+
 	iteratorClosed();
 
 	return true;
@@ -44,29 +141,151 @@ bool QgsVctFeatureIterator::fetchFeature(QgsFeature &feature)
 	feature.setValid(false);
 	if (mClosed)
 		return false;
-	if (mSelectIterator != mSource->mFeatures.constEnd())
+
+	mFetchTimer.start();
+	mFetching = true;
+	const bool found = mUsingFeatureIdList ? nextFeatureUsingList(feature) : nextFeatureTraverseAll(feature);
+	if (mFetching)
+	{
+		mFetchNanoseconds += mFetchTimer.nsecsElapsed();
+		mFetching = false;
+	}
+	if (found)
+		++mFetched;
+	return found;
+}
+
+bool QgsVctFeatureIterator::nextFeatureFilterExpression(QgsFeature &feature)
+{
+	if (!mEvaluateFilter)
+		return QgsAbstractFeatureIteratorFromSource<QgsVctFeatureSource>::nextFeatureFilterExpression(feature);
+	return fetchFeature(feature);
+}
+
+bool QgsVctFeatureIterator::nextFeatureUsingList(QgsFeature &feature)
+{
+	bool hasFeature = false;
+
+	// option 1: we have a list of features to traverse
+	while (mFeatureIdListIterator != mFeatureIdList.constEnd())
+	{
+		const QgsFeatureId id = *mFeatureIdListIterator;
+		++mFeatureIdListIterator;
+		if (mSource->mUseSubsetIndex && !std::binary_search(mSource->mSubsetIndex.constBegin(), mSource->mSubsetIndex.constEnd(), id))
+			continue;
+		int row = mSource->mFeatures.row(id);
+		if (row >= 0 && readRow(row, feature))
+		{
+			hasFeature = true;
+			break;
+		}
+	}
+
+	if (hasFeature)
 	{
-		feature = mSelectIterator.value();
 		feature.setValid(true);
 		feature.setFields(mSource->mFields);
 		geometryToDestinationCrs(feature, mTransform);
-		++mSelectIterator;
-		return true;
 	}
 	else
+		close();
+
+	return hasFeature;
+}
+
+bool QgsVctFeatureIterator::nextFeatureTraverseAll(QgsFeature &feature)
+{
+	bool hasFeature = false;
+
+	// option 2: traversing the whole layer, or the features matching the subset string
+	const int count = mSource->mUseSubsetIndex ? mSource->mSubsetIndex.count() : mSource->mFeatures.count();
+	while (mRow < count)
+	{
+		int row = mSource->mUseSubsetIndex ? mSource->mFeatures.row(mSource->mSubsetIndex.at(mRow)) : mRow;
+		++mRow;
+		if (row >= 0 && readRow(row, feature))
+		{
+			hasFeature = true;
+			break;
+		}
+	}
+
+	if (hasFeature)
 	{
+		feature.setValid(true);
+		feature.setFields(mSource->mFields);
+		geometryToDestinationCrs(feature, mTransform);
+	}
+	else
 		close();
-		return false;
+
+	return hasFeature;
+}
+
+bool QgsVctFeatureIterator::readRow(int row, QgsFeature &feature)
+{
+	const QgsVctFeatureStore &features = mSource->mFeatures;
+	if (!mFilterRect.isNull())
+	{
+		// the stored bounding box rejects most features before their geometry is built
+		if (!features.hasGeometry(row) || !features.boundingBox(row).intersects(mFilterRect))
+			return false;
+	}
+
+	// the geometry is only built when it is returned or needed for the exact test
+	const bool noGeometry = mRequest.flags() & QgsFeatureRequest::NoGeometry;
+	QgsGeometry geometry;
+	if (features.hasGeometry(row) && (!noGeometry || mSelectRectEngine))
+		geometry = features.geometry(row);
+
+	if (mSelectRectEngine)
+	{
+		// using exact test when checking for intersection
+		if (!mSelectRectEngine->intersects(geometry.constGet()))
+			return false;
 	}
+
+	feature.setId(features.id(row));
+	if (noGeometry || geometry.isNull())
+		feature.clearGeometry();
+	else
+		feature.setGeometry(geometry);
+
+	if (mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes)
+	{
+		// attributes outside of the subset are left null
+		QgsAttributes attributes(mSource->mFields.count());
+		for (int field : qgis::as_const(mAttributeList))
+			attributes[field] = features.attribute(row, field);
+		if (mEvaluateFilter)
+		{
+			for (int field : qgis::as_const(mFilterAttributeList))
+				attributes[field] = features.attribute(row, field);
+			feature.setFields(mSource->mFields);
+			feature.setAttributes(attributes);
+			mRequest.expressionContext()->setFeature(feature);
+			if (!mRequest.filterExpression()->evaluate(mRequest.expressionContext()).toBool())
+				return false;
+			for (int field : qgis::as_const(mFilterAttributeList))
+				attributes[field] = QVariant();
+		}
+		feature.setAttributes(attributes);
+	}
+	else
+		feature.setAttributes(features.attributes(row));
+	return true;
 }
 
 QgsVctFeatureSource::QgsVctFeatureSource(const QgsVctProvider *p)
-	: mExtent(p->mExtent)
-	, mGeometryType(p->mGeometryType)
+	: mGeometryType(p->mGeometryType)
 	, mCrs(p->mCrs)
 	, mFeatures(p -> mFeatures)
 	, mFields(p->mFields)
+	, mSubsetIndex(p->mSubsetIndex)
+	, mUseSubsetIndex(p->mUseSubsetIndex)
+	, mProfile(p->mProfile)
 {
+	mSpatialIndex = p->mSpatialIndex ? qgis::make_unique<QgsSpatialIndex>(*p->mSpatialIndex) : nullptr;
 }
 
 QgsFeatureIterator QgsVctFeatureSource::getFeatures(const QgsFeatureRequest &request)
@@ -1,5 +1,6 @@
 #pragma once
 #include "qgsvctprovider.h"
+#include "qgsgeometryengine.h"
 
 class QgsVctFeatureSource final: public QgsAbstractFeatureSource
 {
@@ -8,14 +9,16 @@ public:
 	QgsFeatureIterator getFeatures(const QgsFeatureRequest &request) override;
 
 private:
-	QgsRectangle mExtent;
 	std::unique_ptr< QgsSpatialIndex > mSpatialIndex;
 	QgsFields mFields;
 	QgsWkbTypes::GeometryType mGeometryType;
 	QgsWkbTypes::Type mWkbType = QgsWkbTypes::NoGeometry;
 	QgsCoordinateReferenceSystem mCrs;
-	QgsFeatureMap mFeatures;
+	QgsVctFeatureStore mFeatures;
+	QVector<QgsFeatureId> mSubsetIndex;
+	bool mUseSubsetIndex = false;
 	QgsExpressionContext mExpressionContext;
+	std::shared_ptr<QgsVctProfile> mProfile;
 
 
 	friend class QgsVctFeatureIterator;
@@ -33,11 +36,36 @@ public:
 	
 protected:
 	bool fetchFeature(QgsFeature &feature) override;
+	//! A filter expression on columns outside of the attribute subset is evaluated by readRow()
+	bool nextFeatureFilterExpression(QgsFeature &feature) override;
 
 private:
-	QgsFeatureMap::const_iterator mSelectIterator;
+	bool nextFeatureUsingList(QgsFeature &feature);
+	bool nextFeatureTraverseAll(QgsFeature &feature);
+	//! Fills \a feature from \a row if it passes the filter rectangle, honoring the request flags
+	bool readRow(int row, QgsFeature &feature);
+
+	QgsRectangle mFilterRect;
+	QgsAttributeList mAttributeList;
+	//columns read only for the filter expression, they are left null in the returned features
+	QgsAttributeList mFilterAttributeList;
+	bool mEvaluateFilter = false;
+	QgsGeometry mSelectRectGeom;
+	std::unique_ptr< QgsGeometryEngine > mSelectRectEngine;
+
+	int mRow = 0;
+	bool mUsingFeatureIdList = false;
+	QList<QgsFeatureId> mFeatureIdList;
+	QList<QgsFeatureId>::const_iterator mFeatureIdListIterator;
 	QgsCoordinateTransform mTransform;
 
+	//the lifetime of the iterator and the time spent in fetchFeature, added to the profile on close
+	std::unique_ptr<QgsVctTraceSpan> mSpan;
+	QElapsedTimer mFetchTimer;
+	bool mFetching = false;
+	qint64 mFetchNanoseconds = 0;
+	qint64 mFetched = 0;
+
 
 };
 
@@ -0,0 +1,1467 @@
+#include "qgsvctfeaturestore.h"
+#include "qgsvctrecordcache.h"
+#include "qgsmultipoint.h"
+#include "qgsmultilinestring.h"
+#include "qgsmultipolygon.h"
+#include "qgspolygon.h"
+#include "qgslinestring.h"
+#include "qgspoint.h"
+
+#include <QDataStream>
+#include <QIODevice>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+	//raw blocks are split, QDataStream counts bytes in int
+	const qint64 RAW_BLOCK_SIZE = 64 * 1024 * 1024;
+
+	//string columns are dictionary encoded when every value repeats this often on average
+	const int DICTIONARY_MINIMUM_REPEAT = 4;
+	//larger dictionaries are decoded again, lookups and the index would cost more than they save
+	const int DICTIONARY_MAXIMUM_SIZE = 65536;
+
+	//header of the data of a string, and of a node of a hash
+	const qint64 STRING_OVERHEAD = 24;
+	const qint64 HASH_NODE_OVERHEAD = 24;
+
+	template <typename T>
+	void writeBuffer(QDataStream &stream, const QVector<T> &buffer)
+	{
+		stream << qint32(buffer.count());
+		const char *data = reinterpret_cast<const char *>(buffer.constData());
+		const qint64 size = qint64(buffer.count()) * qint64(sizeof(T));
+		for (qint64 offset = 0; offset < size; offset += RAW_BLOCK_SIZE)
+			stream.writeRawData(data + offset, int(qMin(RAW_BLOCK_SIZE, size - offset)));
+	}
+
+	//Whether the rest of the stream can hold count elements of elementSize bytes, a corrupt count must not be allocated
+	bool countFits(QDataStream &stream, qint32 count, qint64 elementSize)
+	{
+		return count >= 0 && stream.device() && qint64(count) <= stream.device()->bytesAvailable() / elementSize;
+	}
+
+	template <typename T>
+	bool readBuffer(QDataStream &stream, QVector<T> &buffer)
+	{
+		qint32 count = -1;
+		stream >> count;
+		if (stream.status() != QDataStream::Ok || !countFits(stream, count, qint64(sizeof(T))))
+			return false;
+		buffer.resize(count);
+		char *data = reinterpret_cast<char *>(buffer.data());
+		const qint64 size = qint64(count) * qint64(sizeof(T));
+		for (qint64 offset = 0; offset < size; offset += RAW_BLOCK_SIZE)
+		{
+			const int block = int(qMin(RAW_BLOCK_SIZE, size - offset));
+			if (stream.readRawData(data + offset, block) != block)
+				return false;
+		}
+		return true;
+	}
+
+	//Keeps the given rows of a column buffer in order, unused buffers are empty and stay so
+	template <typename T>
+	void selectRows(QVector<T> &buffer, const QVector<int> &rows)
+	{
+		if (buffer.isEmpty())
+			return;
+		QVector<T> selected;
+		selected.reserve(rows.count());
+		for (int row : rows)
+			selected.append(buffer.at(row));
+		buffer = selected;
+	}
+
+	template <typename T>
+	void copyRow(QVector<T> &buffer, int from, int to)
+	{
+		if (!buffer.isEmpty())
+			buffer[to] = buffer.at(from);
+	}
+
+	//Sets a row of a column buffer, an empty buffer is only allocated for a value
+	template <typename T>
+	void setRow(QVector<T> &buffer, int rowCount, int row, const T &value, bool isValue)
+	{
+		if (buffer.isEmpty())
+		{
+			if (!isValue)
+				return;
+			buffer.resize(rowCount);
+		}
+		buffer[row] = value;
+	}
+
+	template <typename T>
+	void resizeRows(QVector<T> &buffer, int rowCount)
+	{
+		if (!buffer.isEmpty())
+			buffer.resize(rowCount);
+	}
+
+	template <typename T>
+	void appendRows(QVector<T> &buffer, int rowCount, const QVector<T> &other, int otherCount)
+	{
+		if (buffer.isEmpty() && other.isEmpty())
+			return;
+		buffer.resize(rowCount);
+		buffer += other;
+		buffer.resize(rowCount + otherCount);
+	}
+
+	//allocation of a buffer, unused capacity included
+	template <typename T>
+	qint64 bufferBytes(const QVector<T> &buffer)
+	{
+		return qint64(buffer.capacity()) * qint64(sizeof(T));
+	}
+
+	qint64 stringBytes(const QVector<QString> &strings)
+	{
+		qint64 bytes = bufferBytes(strings);
+		for (const QString &string : strings)
+		{
+			if (!string.isEmpty())
+				bytes += STRING_OVERHEAD + qint64(string.capacity()) * qint64(sizeof(QChar));
+		}
+		return bytes;
+	}
+}
+
+QgsVctFeatureStore::Column::Storage QgsVctFeatureStore::Column::typeStorage(QVariant::Type type)
+{
+	switch (type)
+	{
+	case QVariant::Int:
+	case QVariant::LongLong:
+		return Integers;
+	case QVariant::Double:
+		return Doubles;
+	case QVariant::String:
+		return Strings;
+	default:
+		return Variants;
+	}
+}
+
+QgsVctFeatureStore::Column::State QgsVctFeatureStore::Column::valueState(const QVariant &value, QVariant::Type type, QVariant &converted)
+{
+	converted = value;
+	//blank text is null in columns that are not strings
+	if (value.isNull() || (type != QVariant::String && value.type() == QVariant::String && value.toString().trimmed().isEmpty()))
+		return Null;
+	if (!convertValue(converted, type))
+		return ConversionError;
+	return Value;
+}
+
+QVariant QgsVctFeatureStore::Column::value(int row) const
+{
+	if (states.at(row) != Value)
+		return QVariant(type);
+	switch (storage())
+	{
+	case Integers:
+		return type == QVariant::Int ? QVariant(int(integers.at(row))) : QVariant(qlonglong(integers.at(row)));
+	case Doubles:
+		return doubles.at(row);
+	case Strings:
+		return strings.at(row);
+	case Dictionary:
+		return dictionary.at(codes.at(row));
+	case Variants:
+		break;
+	}
+	return variants.at(row);
+}
+
+QVariant QgsVctFeatureStore::Column::sourceValue(int row) const
+{
+	if (states.at(row) == ConversionError)
+		return errorTexts.at(row);
+	return value(row);
+}
+
+void QgsVctFeatureStore::Column::setValue(int row, const QVariant &value)
+{
+	const Storage columnStorage = storage();
+	QVariant converted;
+	const State state = valueState(value, type, converted);
+	const bool isValue = state == Value;
+
+	states[row] = state;
+	if (state == ConversionError && errorTexts.isEmpty())
+		errorTexts.resize(states.count());
+	if (!errorTexts.isEmpty())
+		errorTexts[row] = state == ConversionError ? value.toString() : QString();
+
+	switch (columnStorage)
+	{
+	case Integers:
+		setRow(integers, count(), row, isValue ? converted.toLongLong() : 0, isValue);
+		break;
+	case Doubles:
+		setRow(doubles, count(), row, isValue ? converted.toDouble() : 0, isValue);
+		break;
+	case Strings:
+		setRow(strings, count(), row, isValue ? converted.toString() : QString(), isValue);
+		break;
+	case Dictionary:
+	{
+		if (!isValue)
+		{
+			setRow(codes, count(), row, 0, false);
+			break;
+		}
+		const QString text = converted.toString();
+		int code = dictionaryIndex.value(text, -1);
+		if (code < 0)
+		{
+			code = dictionary.count();
+			dictionaryIndex.insert(text, code);
+			dictionary.append(text);
+		}
+		setRow(codes, count(), row, code, true);
+		if (dictionary.count() > DICTIONARY_MAXIMUM_SIZE)
+			decode();
+		break;
+	}
+	case Variants:
+		setRow(variants, count(), row, isValue ? converted : QVariant(), isValue);
+		break;
+	}
+}
+
+void QgsVctFeatureStore::Column::resize(int count)
+{
+	//new rows are null
+	states.resize(count);
+	resizeRows(integers, count);
+	resizeRows(doubles, count);
+	resizeRows(strings, count);
+	resizeRows(codes, count);
+	resizeRows(variants, count);
+	resizeRows(errorTexts, count);
+}
+
+void QgsVctFeatureStore::Column::append(const Column &other)
+{
+	const int rowCount = count();
+	//codes of different dictionaries are interned one by one
+	if (other.type != type || encoded || other.encoded)
+	{
+		resize(rowCount + other.count());
+		for (int row = 0; row < other.count(); row++)
+			setValue(rowCount + row, other.sourceValue(row));
+		return;
+	}
+
+	states += other.states;
+	appendRows(integers, rowCount, other.integers, other.count());
+	appendRows(doubles, rowCount, other.doubles, other.count());
+	appendRows(strings, rowCount, other.strings, other.count());
+	appendRows(variants, rowCount, other.variants, other.count());
+	appendRows(errorTexts, rowCount, other.errorTexts, other.count());
+}
+
+void QgsVctFeatureStore::Column::copyRow(int from, int to)
+{
+	states[to] = states.at(from);
+	::copyRow(integers, from, to);
+	::copyRow(doubles, from, to);
+	::copyRow(strings, from, to);
+	::copyRow(codes, from, to);
+	::copyRow(variants, from, to);
+	::copyRow(errorTexts, from, to);
+}
+
+void QgsVctFeatureStore::Column::selectRows(const QVector<int> &rows)
+{
+	::selectRows(states, rows);
+	::selectRows(integers, rows);
+	::selectRows(doubles, rows);
+	::selectRows(strings, rows);
+	::selectRows(codes, rows);
+	::selectRows(variants, rows);
+	::selectRows(errorTexts, rows);
+}
+
+void QgsVctFeatureStore::Column::convert(QVariant::Type newType)
+{
+	if (newType == type)
+		return;
+	Column converted;
+	converted.type = newType;
+	converted.resize(count());
+	for (int row = 0; row < count(); row++)
+		converted.setValue(row, sourceValue(row));
+	*this = converted;
+}
+
+bool QgsVctFeatureStore::Column::encode()
+{
+	if (encoded || type != QVariant::String)
+		return false;
+
+	const int maximumSize = std::min(DICTIONARY_MAXIMUM_SIZE, count() / DICTIONARY_MINIMUM_REPEAT);
+	QHash<QString, int> index;
+	QVector<QString> values;
+	QVector<int> rowCodes(count());
+	for (int row = 0; row < count(); row++)
+	{
+		if (states.at(row) != Value)
+			continue;
+		const QString &text = strings.at(row);
+		int code = index.value(text, -1);
+		if (code < 0)
+		{
+			if (values.count() >= maximumSize)
+				return false;
+			code = values.count();
+			index.insert(text, code);
+			values.append(text);
+		}
+		rowCodes[row] = code;
+	}
+
+	encoded = true;
+	dictionary = values;
+	dictionaryIndex = index;
+	codes = values.isEmpty() ? QVector<int>() : rowCodes;
+	strings.clear();
+	return true;
+}
+
+void QgsVctFeatureStore::Column::decode()
+{
+	if (!encoded)
+		return;
+	if (!codes.isEmpty())
+		strings.resize(count());
+	for (int row = 0; row < count(); row++)
+	{
+		if (states.at(row) == Value)
+			strings[row] = dictionary.at(codes.at(row));
+	}
+	encoded = false;
+	dictionary.clear();
+	dictionaryIndex.clear();
+	codes.clear();
+}
+
+bool QgsVctFeatureStore::convertValue(QVariant &value, QVariant::Type type)
+{
+	if (value.type() == type)
+		return true;
+
+	switch (type)
+	{
+	case QVariant::Int:
+	{
+		//QVariant truncates wider integers silently
+		QVariant wide = value;
+		if (!convertValue(wide, QVariant::LongLong))
+			return false;
+		const qlonglong integer = wide.toLongLong();
+		if (integer < std::numeric_limits<int>::min() || integer > std::numeric_limits<int>::max())
+			return false;
+		value = int(integer);
+		return true;
+	}
+	case QVariant::LongLong:
+	case QVariant::Double:
+		if (value.type() == QVariant::String)
+		{
+			bool ok = false;
+			const QString text = value.toString().trimmed();
+			if (type == QVariant::LongLong)
+			{
+				const qlonglong integer = text.toLongLong(&ok);
+				if (ok)
+					value = integer;
+			}
+			else
+			{
+				const double number = text.toDouble(&ok);
+				if (ok)
+					value = number;
+			}
+			return ok;
+		}
+		break;
+	default:
+		break;
+	}
+	return value.convert(int(type));
+}
+
+int QgsVctFeatureStore::row(QgsFeatureId id) const
+{
+	const QVector<QgsFeatureId>::const_iterator it = std::lower_bound(mIds.constBegin(), mIds.constEnd(), id);
+	if (it == mIds.constEnd() || *it != id)
+		return -1;
+	return int(it - mIds.constBegin());
+}
+
+int QgsVctFeatureStore::addFeature(QgsFeatureId id)
+{
+	mIds.append(id);
+	mGeometryTypes.append(quint8(QgsWkbTypes::NullGeometry));
+	mFeaturePartBegin.append(mPartRingBegin.count());
+	mFeaturePartCount.append(0);
+	mBoundingBoxes.append(QgsRectangle());
+	mRecordBegin.append(-1);
+	mRecordEnd.append(-1);
+	mAttributeBegin.append(-1);
+	mAttributeEnd.append(-1);
+	mFeatureCodes.append(-1);
+	mGraphicCodes.append(-1);
+	for (Column &column : mColumns)
+		column.resize(mIds.count());
+	return mIds.count() - 1;
+}
+
+int QgsVctFeatureStore::internCode(const char *code, int size)
+{
+	//records of a layer mostly share their codes, try the last one first
+	if (mLastCode >= 0)
+	{
+		const QByteArray &last = mCodes.at(mLastCode);
+		if (last.size() == size && memcmp(last.constData(), code, size_t(size)) == 0)
+			return mLastCode;
+	}
+	const QByteArray text(code, size);
+	mLastCode = mCodeIndex.value(text, -1);
+	if (mLastCode < 0)
+	{
+		mLastCode = mCodes.count();
+		mCodeIndex.insert(text, mLastCode);
+		mCodes.append(text);
+	}
+	return mLastCode;
+}
+
+void QgsVctFeatureStore::setRecordCodes(int row, const char *featureCode, int featureCodeSize, const char *graphicCode, int graphicCodeSize)
+{
+	mFeatureCodes[row] = internCode(featureCode, featureCodeSize);
+	mGraphicCodes[row] = internCode(graphicCode, graphicCodeSize);
+}
+
+QByteArray QgsVctFeatureStore::featureCode(int row) const
+{
+	const int code = mFeatureCodes.at(row);
+	return code < 0 ? QByteArray() : mCodes.at(code);
+}
+
+QByteArray QgsVctFeatureStore::graphicCode(int row) const
+{
+	const int code = mGraphicCodes.at(row);
+	return code < 0 ? QByteArray() : mCodes.at(code);
+}
+
+void QgsVctFeatureStore::normalize()
+{
+	const int rowCount = mIds.count();
+	bool sorted = true;
+	for (int i = 1; i < rowCount && sorted; i++)
+		sorted = mIds.at(i - 1) < mIds.at(i);
+	if (sorted)
+		return;
+
+	QVector<int> order(rowCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return mIds.at(a) < mIds.at(b); });
+
+	//of rows sharing an id, the last one read wins
+	QVector<int> rows;
+	rows.reserve(rowCount);
+	for (int i = 0; i < rowCount; i++)
+	{
+		if (i + 1 < rowCount && mIds.at(order.at(i + 1)) == mIds.at(order.at(i)))
+		{
+			releaseGeometry(order.at(i));
+			continue;
+		}
+		rows.append(order.at(i));
+	}
+
+	QVector<QgsFeatureId> ids;
+	QVector<quint8> geometryTypes;
+	QVector<int> partBegin;
+	QVector<int> partCount;
+	QVector<QgsRectangle> boxes;
+	QVector<qint64> recordBegin;
+	QVector<qint64> recordEnd;
+	QVector<qint64> attributeBegin;
+	QVector<qint64> attributeEnd;
+	QVector<int> featureCodes;
+	QVector<int> graphicCodes;
+	ids.reserve(rows.count());
+	geometryTypes.reserve(rows.count());
+	partBegin.reserve(rows.count());
+	partCount.reserve(rows.count());
+	boxes.reserve(rows.count());
+	recordBegin.reserve(rows.count());
+	recordEnd.reserve(rows.count());
+	attributeBegin.reserve(rows.count());
+	attributeEnd.reserve(rows.count());
+	featureCodes.reserve(rows.count());
+	graphicCodes.reserve(rows.count());
+	for (int row : qAsConst(rows))
+	{
+		ids.append(mIds.at(row));
+		geometryTypes.append(mGeometryTypes.at(row));
+		partBegin.append(mFeaturePartBegin.at(row));
+		partCount.append(mFeaturePartCount.at(row));
+		boxes.append(mBoundingBoxes.at(row));
+		recordBegin.append(mRecordBegin.at(row));
+		recordEnd.append(mRecordEnd.at(row));
+		attributeBegin.append(mAttributeBegin.at(row));
+		attributeEnd.append(mAttributeEnd.at(row));
+		featureCodes.append(mFeatureCodes.at(row));
+		graphicCodes.append(mGraphicCodes.at(row));
+	}
+	mIds = ids;
+	mGeometryTypes = geometryTypes;
+	mFeaturePartBegin = partBegin;
+	mFeaturePartCount = partCount;
+	mBoundingBoxes = boxes;
+	mRecordBegin = recordBegin;
+	mRecordEnd = recordEnd;
+	mAttributeBegin = attributeBegin;
+	mAttributeEnd = attributeEnd;
+	mFeatureCodes = featureCodes;
+	mGraphicCodes = graphicCodes;
+
+	for (Column &column : mColumns)
+		column.selectRows(rows);
+}
+
+void QgsVctFeatureStore::append(const QgsVctFeatureStore &other)
+{
+	if (mIds.isEmpty() && mX.isEmpty())
+	{
+		*this = other;
+		return;
+	}
+
+	const int partOffset = mPartRingBegin.count();
+	const int ringOffset = mRingVertexBegin.count();
+	const int vertexOffset = mX.count();
+	const int rowCount = mIds.count();
+
+	mIds += other.mIds;
+	mGeometryTypes += other.mGeometryTypes;
+	mFeaturePartCount += other.mFeaturePartCount;
+	mBoundingBoxes += other.mBoundingBoxes;
+	mRecordBegin += other.mRecordBegin;
+	mRecordEnd += other.mRecordEnd;
+	mAttributeBegin += other.mAttributeBegin;
+	mAttributeEnd += other.mAttributeEnd;
+	mFeatureCodes.reserve(mIds.count());
+	mGraphicCodes.reserve(mIds.count());
+	for (int row = 0; row < other.count(); row++)
+	{
+		const int featureCode = other.mFeatureCodes.at(row);
+		const int graphicCode = other.mGraphicCodes.at(row);
+		mFeatureCodes.append(featureCode < 0 ? -1 : internCode(other.mCodes.at(featureCode).constData(), other.mCodes.at(featureCode).size()));
+		mGraphicCodes.append(graphicCode < 0 ? -1 : internCode(other.mCodes.at(graphicCode).constData(), other.mCodes.at(graphicCode).size()));
+	}
+	mFeaturePartBegin.reserve(mIds.count());
+	for (int begin : other.mFeaturePartBegin)
+		mFeaturePartBegin.append(begin + partOffset);
+
+	mPartRingCount += other.mPartRingCount;
+	mPartRingBegin.reserve(mPartRingCount.count());
+	for (int begin : other.mPartRingBegin)
+		mPartRingBegin.append(begin + ringOffset);
+	mRingVertexCount += other.mRingVertexCount;
+	mRingVertexBegin.reserve(mRingVertexCount.count());
+	for (int begin : other.mRingVertexBegin)
+		mRingVertexBegin.append(begin + vertexOffset);
+	mX += other.mX;
+	mY += other.mY;
+	mGarbageVertices += other.mGarbageVertices;
+
+	const int columnCount = std::max(mColumns.count(), other.mColumns.count());
+	for (int i = mColumns.count(); i < columnCount; i++)
+	{
+		Column column;
+		column.type = other.mColumns.at(i).type;
+		mColumns.append(column);
+	}
+	for (int i = 0; i < columnCount; i++)
+	{
+		Column &column = mColumns[i];
+		column.resize(rowCount);
+		if (i < other.mColumns.count())
+			column.append(other.mColumns.at(i));
+		else
+			column.resize(mIds.count());
+	}
+}
+
+QVector<QgsVctFeatureStore> QgsVctFeatureStore::partition(const QVector<int> &parts, int count) const
+{
+	QVector<QVector<int>> rows(count);
+	for (int row = 0; row < mIds.count(); row++)
+	{
+		if (parts.at(row) >= 0)
+			rows[parts.at(row)].append(row);
+	}
+
+	QVector<QgsVctFeatureStore> stores(count);
+	for (int part = 0; part < count; part++)
+	{
+		QgsVctFeatureStore &store = stores[part];
+		const QVector<int> &partRows = rows.at(part);
+		store.mLazy = mLazy;
+		store.mDecoder = mDecoder;
+		store.mRecordCache = mRecordCache;
+		store.mFileFields = mFileFields;
+		//the code indexes of the rows stay valid with the whole code table
+		store.mCodes = mCodes;
+		store.mCodeIndex = mCodeIndex;
+		store.mColumns = mColumns;
+		for (Column &column : store.mColumns)
+			column.selectRows(partRows);
+
+		for (int row : partRows)
+		{
+			store.mIds.append(mIds.at(row));
+			store.mGeometryTypes.append(mGeometryTypes.at(row));
+			store.mBoundingBoxes.append(mBoundingBoxes.at(row));
+			store.mRecordBegin.append(mRecordBegin.at(row));
+			store.mRecordEnd.append(mRecordEnd.at(row));
+			store.mAttributeBegin.append(mAttributeBegin.at(row));
+			store.mAttributeEnd.append(mAttributeEnd.at(row));
+			store.mFeatureCodes.append(mFeatureCodes.at(row));
+			store.mGraphicCodes.append(mGraphicCodes.at(row));
+
+			const int partBegin = mFeaturePartBegin.at(row);
+			const int partEnd = partBegin + mFeaturePartCount.at(row);
+			store.mFeaturePartBegin.append(store.mPartRingBegin.count());
+			store.mFeaturePartCount.append(mFeaturePartCount.at(row));
+			for (int featurePart = partBegin; featurePart < partEnd; featurePart++)
+			{
+				const int ringBegin = mPartRingBegin.at(featurePart);
+				const int ringEnd = ringBegin + mPartRingCount.at(featurePart);
+				store.mPartRingBegin.append(store.mRingVertexBegin.count());
+				store.mPartRingCount.append(mPartRingCount.at(featurePart));
+				for (int ring = ringBegin; ring < ringEnd; ring++)
+				{
+					const int vertexBegin = mRingVertexBegin.at(ring);
+					const int vertexCount = mRingVertexCount.at(ring);
+					store.mRingVertexBegin.append(store.mX.count());
+					store.mRingVertexCount.append(vertexCount);
+					store.mX.append(mX.mid(vertexBegin, vertexCount));
+					store.mY.append(mY.mid(vertexBegin, vertexCount));
+				}
+			}
+		}
+	}
+	return stores;
+}
+
+int QgsVctFeatureStore::removeFeatures(const QgsFeatureIds &ids)
+{
+	QVector<bool> keep(mIds.count(), true);
+	int removed = 0;
+	for (QgsFeatureId id : ids)
+	{
+		const int r = row(id);
+		if (r < 0)
+			continue;
+		keep[r] = false;
+		releaseGeometry(r);
+		removed++;
+	}
+	if (removed)
+		keepRows(keep);
+	return removed;
+}
+
+void QgsVctFeatureStore::keepRows(const QVector<bool> &keep)
+{
+	int target = 0;
+	for (int row = 0; row < mIds.count(); row++)
+	{
+		if (!keep.at(row))
+			continue;
+		if (target != row)
+		{
+			mIds[target] = mIds.at(row);
+			mGeometryTypes[target] = mGeometryTypes.at(row);
+			mFeaturePartBegin[target] = mFeaturePartBegin.at(row);
+			mFeaturePartCount[target] = mFeaturePartCount.at(row);
+			mBoundingBoxes[target] = mBoundingBoxes.at(row);
+			mRecordBegin[target] = mRecordBegin.at(row);
+			mRecordEnd[target] = mRecordEnd.at(row);
+			mAttributeBegin[target] = mAttributeBegin.at(row);
+			mAttributeEnd[target] = mAttributeEnd.at(row);
+			mFeatureCodes[target] = mFeatureCodes.at(row);
+			mGraphicCodes[target] = mGraphicCodes.at(row);
+			for (Column &column : mColumns)
+				column.copyRow(row, target);
+		}
+		target++;
+	}
+	mIds.resize(target);
+	mGeometryTypes.resize(target);
+	mFeaturePartBegin.resize(target);
+	mFeaturePartCount.resize(target);
+	mBoundingBoxes.resize(target);
+	mRecordBegin.resize(target);
+	mRecordEnd.resize(target);
+	mAttributeBegin.resize(target);
+	mAttributeEnd.resize(target);
+	mFeatureCodes.resize(target);
+	mGraphicCodes.resize(target);
+	for (Column &column : mColumns)
+		column.resize(target);
+
+	if (mGarbageVertices > mX.count() / 2)
+		compactGeometries();
+}
+
+void QgsVctFeatureStore::releaseGeometry(int row)
+{
+	const int partBegin = mFeaturePartBegin.at(row);
+	const int partEnd = partBegin + mFeaturePartCount.at(row);
+	for (int part = partBegin; part < partEnd; part++)
+	{
+		const int ringBegin = mPartRingBegin.at(part);
+		const int ringEnd = ringBegin + mPartRingCount.at(part);
+		for (int ring = ringBegin; ring < ringEnd; ring++)
+			mGarbageVertices += mRingVertexCount.at(ring);
+	}
+	mFeaturePartCount[row] = 0;
+	mRecordBegin[row] = -1;
+	mRecordEnd[row] = -1;
+}
+
+void QgsVctFeatureStore::compactGeometries()
+{
+	QVector<int> partRingBegin, partRingCount, ringVertexBegin, ringVertexCount;
+	QVector<double> x, y;
+	x.reserve(mX.count() - mGarbageVertices);
+	y.reserve(mY.count() - mGarbageVertices);
+	for (int row = 0; row < mIds.count(); row++)
+	{
+		const int partBegin = mFeaturePartBegin.at(row);
+		const int partEnd = partBegin + mFeaturePartCount.at(row);
+		mFeaturePartBegin[row] = partRingBegin.count();
+		for (int part = partBegin; part < partEnd; part++)
+		{
+			const int ringBegin = mPartRingBegin.at(part);
+			const int ringEnd = ringBegin + mPartRingCount.at(part);
+			partRingBegin.append(ringVertexBegin.count());
+			partRingCount.append(mPartRingCount.at(part));
+			for (int ring = ringBegin; ring < ringEnd; ring++)
+			{
+				const int vertexBegin = mRingVertexBegin.at(ring);
+				const int vertexCount = mRingVertexCount.at(ring);
+				ringVertexBegin.append(x.count());
+				ringVertexCount.append(vertexCount);
+				x.append(mX.mid(vertexBegin, vertexCount));
+				y.append(mY.mid(vertexBegin, vertexCount));
+			}
+		}
+	}
+	mPartRingBegin = partRingBegin;
+	mPartRingCount = partRingCount;
+	mRingVertexBegin = ringVertexBegin;
+	mRingVertexCount = ringVertexCount;
+	mX = x;
+	mY = y;
+	mGarbageVertices = 0;
+}
+
+void QgsVctFeatureStore::beginGeometry(int row, QgsWkbTypes::GeometryType type, qint64 recordBegin)
+{
+	releaseGeometry(row);
+	mBuildRow = row;
+	mBuildLazy = mLazy && recordBegin >= 0;
+	mBuildHasParts = false;
+	mBuildBox.setMinimal();
+	mGeometryTypes[row] = quint8(type);
+	mFeaturePartBegin[row] = mPartRingBegin.count();
+	mFeaturePartCount[row] = 0;
+	if (mBuildLazy)
+		mRecordBegin[row] = recordBegin;
+}
+
+void QgsVctFeatureStore::beginPart()
+{
+	mBuildHasParts = true;
+	if (mBuildLazy)
+		return;
+	mPartRingBegin.append(mRingVertexBegin.count());
+	mPartRingCount.append(0);
+	++mFeaturePartCount[mBuildRow];
+}
+
+void QgsVctFeatureStore::beginRing()
+{
+	if (mBuildLazy)
+		return;
+	mRingVertexBegin.append(mX.count());
+	mRingVertexCount.append(0);
+	++mPartRingCount.last();
+}
+
+void QgsVctFeatureStore::endGeometry(qint64 recordEnd)
+{
+	mBoundingBoxes[mBuildRow] = mBuildHasParts ? mBuildBox : QgsRectangle();
+	if (mBuildLazy)
+		mRecordEnd[mBuildRow] = recordEnd;
+	mBuildRow = -1;
+	mBuildLazy = false;
+}
+
+void QgsVctFeatureStore::deferAttributes(int row, qint64 begin, qint64 end)
+{
+	//the columns keep nulls, which take no room
+	for (Column &column : mColumns)
+		column.setValue(row, QVariant());
+	mAttributeBegin[row] = begin;
+	mAttributeEnd[row] = end;
+}
+
+void QgsVctFeatureStore::setDecoder(const std::shared_ptr<const QgsVctRecordDecoder> &decoder, qint64 cacheBudget)
+{
+	mDecoder = decoder;
+	mRecordCache = std::make_shared<QgsVctRecordCache>(cacheBudget);
+}
+
+bool QgsVctFeatureStore::hasLazyGeometries() const
+{
+	for (qint64 begin : mRecordBegin)
+	{
+		if (begin >= 0)
+			return true;
+	}
+	return false;
+}
+
+bool QgsVctFeatureStore::hasDeferredAttributes() const
+{
+	for (qint64 begin : mAttributeBegin)
+	{
+		if (begin >= 0)
+			return true;
+	}
+	return false;
+}
+
+void QgsVctFeatureStore::loadRecords()
+{
+	for (int row = 0; row < mIds.count(); row++)
+	{
+		if (mRecordBegin.at(row) >= 0)
+			setGeometry(row, decodeGeometry(row));
+		if (mAttributeBegin.at(row) >= 0)
+			loadAttributes(row);
+	}
+	mFileFields.clear();
+	mDecoder.reset();
+	mRecordCache.reset();
+}
+
+QByteArray QgsVctFeatureStore::recordText(int row) const
+{
+	return mDecoder ? mDecoder->text(mRecordBegin.at(row), mRecordEnd.at(row)) : QByteArray();
+}
+
+QByteArray QgsVctFeatureStore::attributeText(int row) const
+{
+	//columns added, removed or reordered since the file was read are written from their values
+	if (!mDecoder || !mFileFields.isEmpty())
+		return QByteArray();
+	return mDecoder->text(mAttributeBegin.at(row), mAttributeEnd.at(row));
+}
+
+void QgsVctFeatureStore::moveRecord(int row, qint64 begin, qint64 end)
+{
+	mRecordBegin[row] = begin;
+	mRecordEnd[row] = end;
+}
+
+void QgsVctFeatureStore::moveAttributes(int row, qint64 begin, qint64 end)
+{
+	mAttributeBegin[row] = begin;
+	mAttributeEnd[row] = end;
+}
+
+void QgsVctFeatureStore::replaceFile(const std::shared_ptr<const QgsVctRecordDecoder> &decoder)
+{
+	mDecoder = decoder;
+	if (mFileFields.isEmpty())
+		return;
+	//the cached rows are in the order of the fields of the previous file, which its other users still read
+	mFileFields.clear();
+	if (mRecordCache)
+		mRecordCache = std::make_shared<QgsVctRecordCache>(mRecordCache->budget());
+}
+
+qint64 QgsVctFeatureStore::coordinateBytes() const
+{
+	return bufferBytes(mGeometryTypes) + bufferBytes(mFeaturePartBegin) + bufferBytes(mFeaturePartCount)
+		+ bufferBytes(mBoundingBoxes) + bufferBytes(mRecordBegin) + bufferBytes(mRecordEnd)
+		+ bufferBytes(mPartRingBegin) + bufferBytes(mPartRingCount) + bufferBytes(mRingVertexBegin)
+		+ bufferBytes(mRingVertexCount) + bufferBytes(mX) + bufferBytes(mY);
+}
+
+qint64 QgsVctFeatureStore::attributeBytes() const
+{
+	qint64 bytes = bufferBytes(mAttributeBegin) + bufferBytes(mAttributeEnd) + bufferBytes(mFileFields)
+		+ bufferBytes(mFeatureCodes) + bufferBytes(mGraphicCodes) + bufferBytes(mCodes);
+	for (const QByteArray &code : mCodes)
+		bytes += STRING_OVERHEAD + code.capacity();
+	bytes += qint64(mCodeIndex.count()) * (qint64(sizeof(QByteArray)) + qint64(sizeof(int)) + HASH_NODE_OVERHEAD);
+
+	for (const Column &column : mColumns)
+	{
+		bytes += bufferBytes(column.states) + bufferBytes(column.integers) + bufferBytes(column.doubles)
+			+ stringBytes(column.strings) + stringBytes(column.dictionary) + bufferBytes(column.codes)
+			+ stringBytes(column.errorTexts) + bufferBytes(column.variants);
+		//the dictionary index shares the strings of the dictionary
+		bytes += qint64(column.dictionaryIndex.count()) * (qint64(sizeof(QString)) + qint64(sizeof(int)) + HASH_NODE_OVERHEAD);
+		for (const QVariant &value : column.variants)
+		{
+			if (value.type() == QVariant::String || value.type() == QVariant::ByteArray)
+				bytes += STRING_OVERHEAD + qint64(value.toString().size()) * qint64(sizeof(QChar));
+		}
+	}
+	return bytes;
+}
+
+qint64 QgsVctFeatureStore::indexBytes() const
+{
+	return bufferBytes(mIds);
+}
+
+qint64 QgsVctFeatureStore::cachedBytes() const
+{
+	return mRecordCache ? mRecordCache->size() : 0;
+}
+
+void QgsVctFeatureStore::clearCache() const
+{
+	if (mRecordCache)
+		mRecordCache->clear();
+}
+
+QgsGeometry QgsVctFeatureStore::decodeGeometry(int row) const
+{
+	const QgsFeatureId id = mIds.at(row);
+	QgsGeometry geometry;
+	if (mRecordCache && mRecordCache->geometry(id, geometry))
+		return geometry;
+	if (!mDecoder)
+		return QgsGeometry();
+
+	QgsVctFeatureStore record;
+	mDecoder->decode(mRecordBegin.at(row), mRecordEnd.at(row), geometryType(row), record);
+	geometry = record.isEmpty() ? QgsGeometry() : record.geometry(0);
+	if (mRecordCache)
+		mRecordCache->insertGeometry(id, geometry, record.vertexCount());
+	return geometry;
+}
+
+QgsAttributes QgsVctFeatureStore::decodeAttributes(int row) const
+{
+	const QgsFeatureId id = mIds.at(row);
+	QgsAttributes values;
+	if (mRecordCache && mRecordCache->attributes(id, values))
+		return values;
+	if (!mDecoder)
+		return QgsAttributes();
+
+	values = mDecoder->decodeAttributes(mAttributeBegin.at(row), mAttributeEnd.at(row));
+	if (mRecordCache)
+		mRecordCache->insertAttributes(id, values);
+	return values;
+}
+
+QVariant QgsVctFeatureStore::deferredAttribute(const QgsAttributes &values, int field, bool *error, QString *text) const
+{
+	const int fileField = mFileFields.isEmpty() ? field : mFileFields.at(field);
+	const QVariant value = fileField >= 0 ? values.value(fileField) : QVariant();
+	QVariant converted;
+	const Column::State state = Column::valueState(value, mColumns.at(field).type, converted);
+	if (error)
+		*error = state == Column::ConversionError;
+	if (text && state == Column::ConversionError)
+		*text = value.toString();
+	return state == Column::Value ? converted : QVariant(mColumns.at(field).type);
+}
+
+void QgsVctFeatureStore::loadAttributes(int row)
+{
+	const QgsAttributes values = decodeAttributes(row);
+	mAttributeBegin[row] = -1;
+	mAttributeEnd[row] = -1;
+	for (int field = 0; field < mColumns.count(); field++)
+	{
+		const int fileField = mFileFields.isEmpty() ? field : mFileFields.at(field);
+		mColumns[field].setValue(row, fileField >= 0 ? values.value(fileField) : QVariant());
+	}
+}
+
+bool QgsVctFeatureStore::hasGeometry(int row) const
+{
+	const quint8 type = mGeometryTypes.at(row);
+	return type != quint8(QgsWkbTypes::NullGeometry) && type != quint8(QgsWkbTypes::UnknownGeometry);
+}
+
+QgsGeometry QgsVctFeatureStore::geometry(int row) const
+{
+	if (mRecordBegin.at(row) >= 0)
+		return decodeGeometry(row);
+
+	const int partBegin = mFeaturePartBegin.at(row);
+	const int partEnd = partBegin + mFeaturePartCount.at(row);
+	auto ringToLineString = [this](int ring)
+	{
+		const int vertexBegin = mRingVertexBegin.at(ring);
+		const int vertexCount = mRingVertexCount.at(ring);
+		return new QgsLineString(mX.mid(vertexBegin, vertexCount), mY.mid(vertexBegin, vertexCount));
+	};
+
+	switch (geometryType(row))
+	{
+	case QgsWkbTypes::PointGeometry:
+	{
+		QgsMultiPoint *multiPoint = new QgsMultiPoint();
+		for (int part = partBegin; part < partEnd; part++)
+		{
+			const int ringBegin = mPartRingBegin.at(part);
+			const int ringEnd = ringBegin + mPartRingCount.at(part);
+			for (int ring = ringBegin; ring < ringEnd; ring++)
+			{
+				const int vertexBegin = mRingVertexBegin.at(ring);
+				const int vertexEnd = vertexBegin + mRingVertexCount.at(ring);
+				for (int vertex = vertexBegin; vertex < vertexEnd; vertex++)
+					multiPoint->addGeometry(new QgsPoint(mX.at(vertex), mY.at(vertex)));
+			}
+		}
+		return QgsGeometry(multiPoint);
+	}
+	case QgsWkbTypes::LineGeometry:
+	{
+		QgsMultiLineString *multiLine = new QgsMultiLineString();
+		for (int part = partBegin; part < partEnd; part++)
+		{
+			if (mPartRingCount.at(part) > 0)
+				multiLine->addGeometry(ringToLineString(mPartRingBegin.at(part)));
+		}
+		return QgsGeometry(multiLine);
+	}
+	case QgsWkbTypes::PolygonGeometry:
+	{
+		QgsMultiPolygon *multiPolygon = new QgsMultiPolygon();
+		for (int part = partBegin; part < partEnd; part++)
+		{
+			const int ringBegin = mPartRingBegin.at(part);
+			const int ringEnd = ringBegin + mPartRingCount.at(part);
+			QgsPolygon *polygon = new QgsPolygon();
+			for (int ring = ringBegin; ring < ringEnd; ring++)
+			{
+				if (ring == ringBegin)
+					polygon->setExteriorRing(ringToLineString(ring));
+				else
+					polygon->addInteriorRing(ringToLineString(ring));
+			}
+			multiPolygon->addGeometry(polygon);
+		}
+		return QgsGeometry(multiPolygon);
+	}
+	default:
+		return QgsGeometry();
+	}
+}
+
+void QgsVctFeatureStore::setGeometry(int row, const QgsGeometry &geometry)
+{
+	if (geometry.isNull())
+	{
+		clearGeometry(row);
+		return;
+	}
+
+	//the buffers only hold linear geometries
+	QgsGeometry linear = geometry;
+	if (QgsWkbTypes::isCurvedType(linear.wkbType()))
+		linear = QgsGeometry(linear.constGet()->segmentize());
+	linear.convertToMultiType();
+
+	beginGeometry(row, linear.type());
+	switch (linear.type())
+	{
+	case QgsWkbTypes::PointGeometry:
+		for (const QgsPointXY &point : linear.asMultiPoint())
+		{
+			beginPart();
+			beginRing();
+			addVertex(point.x(), point.y());
+		}
+		break;
+	case QgsWkbTypes::LineGeometry:
+		for (const QgsPolylineXY &line : linear.asMultiPolyline())
+		{
+			beginPart();
+			beginRing();
+			for (const QgsPointXY &point : line)
+				addVertex(point.x(), point.y());
+		}
+		break;
+	case QgsWkbTypes::PolygonGeometry:
+		for (const QgsPolygonXY &polygon : linear.asMultiPolygon())
+		{
+			beginPart();
+			for (const QgsPolylineXY &ring : polygon)
+			{
+				beginRing();
+				for (const QgsPointXY &point : ring)
+					addVertex(point.x(), point.y());
+			}
+		}
+		break;
+	default:
+		break;
+	}
+	endGeometry();
+}
+
+void QgsVctFeatureStore::clearGeometry(int row)
+{
+	releaseGeometry(row);
+	mGeometryTypes[row] = quint8(QgsWkbTypes::NullGeometry);
+	mBoundingBoxes[row] = QgsRectangle();
+}
+
+void QgsVctFeatureStore::setFieldTypes(const QVector<QVariant::Type> &types)
+{
+	const int oldCount = mColumns.count();
+	if (!mFileFields.isEmpty())
+		mFileFields.resize(types.count());
+	for (int i = oldCount; i < mFileFields.count(); i++)
+		mFileFields[i] = -1;
+	mColumns.resize(types.count());
+	for (int i = 0; i < mColumns.count(); i++)
+	{
+		Column &column = mColumns[i];
+		if (i < oldCount)
+		{
+			column.convert(types.at(i));
+			continue;
+		}
+		column.type = types.at(i);
+		column.resize(mIds.count());
+	}
+}
+
+void QgsVctFeatureStore::addField(QVariant::Type type)
+{
+	Column column;
+	column.type = type;
+	column.resize(mIds.count());
+	mColumns.append(column);
+	//deferred rows have no value for it
+	if (!mFileFields.isEmpty())
+		mFileFields.append(-1);
+}
+
+void QgsVctFeatureStore::removeField(int field)
+{
+	if (field < 0 || field >= mColumns.count())
+		return;
+	if (mFileFields.isEmpty() && hasDeferredAttributes())
+	{
+		mFileFields.resize(mColumns.count());
+		std::iota(mFileFields.begin(), mFileFields.end(), 0);
+	}
+	if (!mFileFields.isEmpty())
+		mFileFields.remove(field);
+	mColumns.remove(field);
+}
+
+QVariant QgsVctFeatureStore::attribute(int row, int field) const
+{
+	if (field < 0 || field >= mColumns.count())
+		return QVariant();
+	if (mAttributeBegin.at(row) >= 0)
+		return deferredAttribute(decodeAttributes(row), field);
+	return mColumns.at(field).value(row);
+}
+
+QgsAttributes QgsVctFeatureStore::attributes(int row) const
+{
+	QgsAttributes attributes(mColumns.count());
+	if (mAttributeBegin.at(row) >= 0)
+	{
+		const QgsAttributes values = decodeAttributes(row);
+		for (int i = 0; i < mColumns.count(); i++)
+			attributes[i] = deferredAttribute(values, i);
+		return attributes;
+	}
+	for (int i = 0; i < mColumns.count(); i++)
+		attributes[i] = mColumns.at(i).value(row);
+	return attributes;
+}
+
+void QgsVctFeatureStore::setAttribute(int row, int field, const QVariant &value)
+{
+	if (field < 0 || field >= mColumns.count())
+		return;
+	//the other values of the row move to the columns with it
+	if (mAttributeBegin.at(row) >= 0)
+		loadAttributes(row);
+	mColumns[field].setValue(row, value);
+}
+
+void QgsVctFeatureStore::setAttributes(int row, const QgsAttributes &attributes)
+{
+	mAttributeBegin[row] = -1;
+	mAttributeEnd[row] = -1;
+	for (int i = mColumns.count(); i < attributes.count(); i++)
+		addField(QVariant::String);
+	for (int i = 0; i < mColumns.count(); i++)
+		mColumns[i].setValue(row, i < attributes.count() ? attributes.at(i) : QVariant());
+}
+
+bool QgsVctFeatureStore::hasConversionError(int row, int field) const
+{
+	if (field < 0 || field >= mColumns.count())
+		return false;
+	if (mAttributeBegin.at(row) >= 0)
+	{
+		bool error = false;
+		deferredAttribute(decodeAttributes(row), field, &error);
+		return error;
+	}
+	return mColumns.at(field).states.at(row) == Column::ConversionError;
+}
+
+QString QgsVctFeatureStore::conversionErrorText(int row, int field) const
+{
+	if (!hasConversionError(row, field))
+		return QString();
+	if (mAttributeBegin.at(row) >= 0)
+	{
+		QString text;
+		deferredAttribute(decodeAttributes(row), field, nullptr, &text);
+		return text;
+	}
+	return mColumns.at(field).errorTexts.at(row);
+}
+
+int QgsVctFeatureStore::conversionErrorCount() const
+{
+	int count = 0;
+	for (const Column &column : mColumns)
+	{
+		if (!column.errorTexts.isEmpty())
+			count += int(std::count(column.states.constBegin(), column.states.constEnd(), quint8(Column::ConversionError)));
+	}
+	return count;
+}
+
+void QgsVctFeatureStore::encodeStrings()
+{
+	//the columns of deferred rows only hold nulls
+	if (hasDeferredAttributes())
+		return;
+	for (Column &column : mColumns)
+		column.encode();
+}
+
+bool QgsVctFeatureStore::isDictionaryEncoded(int field) const
+{
+	return field >= 0 && field < mColumns.count() && mColumns.at(field).encoded;
+}
+
+bool QgsVctFeatureStore::rowsEqualTo(int field, const QString &value, QVector<int> &rows) const
+{
+	if (!isDictionaryEncoded(field))
+		return false;
+	const Column &column = mColumns.at(field);
+	const int code = column.dictionaryIndex.value(value, -1);
+	if (code < 0)
+		return true;
+	for (int row = 0; row < column.count(); row++)
+	{
+		if (column.codes.at(row) == code && column.states.at(row) == Column::Value)
+			rows.append(row);
+	}
+	return true;
+}
+
+bool QgsVctFeatureStore::valueCounts(int field, QHash<QVariant, int> &counts) const
+{
+	if (!isDictionaryEncoded(field))
+		return false;
+	const Column &column = mColumns.at(field);
+	QVector<int> codeCounts(column.dictionary.count(), 0);
+	int nullCount = 0;
+	for (int row = 0; row < column.count(); row++)
+	{
+		if (column.states.at(row) == Column::Value)
+			++codeCounts[column.codes.at(row)];
+		else
+			++nullCount;
+	}
+	if (nullCount)
+		counts[QVariant(column.type)] += nullCount;
+	for (int code = 0; code < codeCounts.count(); code++)
+	{
+		if (codeCounts.at(code))
+			counts[column.dictionary.at(code)] += codeCounts.at(code);
+	}
+	return true;
+}
+
+void QgsVctFeatureStore::feature(int row, QgsFeature &feature) const
+{
+	feature.setId(mIds.at(row));
+	if (hasGeometry(row))
+		feature.setGeometry(geometry(row));
+	else
+		feature.clearGeometry();
+	feature.setAttributes(attributes(row));
+}
+
+void QgsVctFeatureStore::writeTo(QDataStream &stream) const
+{
+	writeBuffer(stream, mIds);
+	writeBuffer(stream, mGeometryTypes);
+	writeBuffer(stream, mFeaturePartBegin);
+	writeBuffer(stream, mFeaturePartCount);
+	writeBuffer(stream, mBoundingBoxes);
+	writeBuffer(stream, mRecordBegin);
+	writeBuffer(stream, mRecordEnd);
+	writeBuffer(stream, mAttributeBegin);
+	writeBuffer(stream, mAttributeEnd);
+	writeBuffer(stream, mFileFields);
+	writeBuffer(stream, mPartRingBegin);
+	writeBuffer(stream, mPartRingCount);
+	writeBuffer(stream, mRingVertexBegin);
+	writeBuffer(stream, mRingVertexCount);
+	writeBuffer(stream, mX);
+	writeBuffer(stream, mY);
+	writeBuffer(stream, mFeatureCodes);
+	writeBuffer(stream, mGraphicCodes);
+	stream << mCodes;
+	stream << qint32(mGarbageVertices);
+	stream << qint32(mColumns.count());
+	for (const Column &column : mColumns)
+	{
+		stream << qint32(column.type);
+		writeBuffer(stream, column.states);
+		writeBuffer(stream, column.integers);
+		writeBuffer(stream, column.doubles);
+		stream << column.strings << column.variants << column.errorTexts;
+		stream << column.encoded << column.dictionary;
+		writeBuffer(stream, column.codes);
+	}
+}
+
+bool QgsVctFeatureStore::readFrom(QDataStream &stream)
+{
+	*this = QgsVctFeatureStore();
+	qint32 garbageVertices = 0;
+	bool ok = readBuffer(stream, mIds)
+		&& readBuffer(stream, mGeometryTypes)
+		&& readBuffer(stream, mFeaturePartBegin)
+		&& readBuffer(stream, mFeaturePartCount)
+		&& readBuffer(stream, mBoundingBoxes)
+		&& readBuffer(stream, mRecordBegin)
+		&& readBuffer(stream, mRecordEnd)
+		&& readBuffer(stream, mAttributeBegin)
+		&& readBuffer(stream, mAttributeEnd)
+		&& readBuffer(stream, mFileFields)
+		&& readBuffer(stream, mPartRingBegin)
+		&& readBuffer(stream, mPartRingCount)
+		&& readBuffer(stream, mRingVertexBegin)
+		&& readBuffer(stream, mRingVertexCount)
+		&& readBuffer(stream, mX)
+		&& readBuffer(stream, mY)
+		&& readBuffer(stream, mFeatureCodes)
+		&& readBuffer(stream, mGraphicCodes);
+	if (ok)
+	{
+		qint32 columnCount = 0;
+		stream >> mCodes >> garbageVertices >> columnCount;
+		mGarbageVertices = garbageVertices;
+		//a column takes at least its type and the counts of its buffers
+		ok = stream.status() == QDataStream::Ok && countFits(stream, columnCount, 4 * qint64(sizeof(qint32)));
+		for (int i = 0; ok && i < columnCount; i++)
+		{
+			Column column;
+			qint32 type = 0;
+			stream >> type;
+			column.type = static_cast<QVariant::Type>(type);
+			ok = readBuffer(stream, column.states) && readBuffer(stream, column.integers) && readBuffer(stream, column.doubles);
+			if (ok)
+			{
+				stream >> column.strings >> column.variants >> column.errorTexts;
+				stream >> column.encoded >> column.dictionary;
+				ok = stream.status() == QDataStream::Ok && readBuffer(stream, column.codes);
+			}
+			for (int code = 0; code < column.dictionary.count(); code++)
+				column.dictionaryIndex.insert(column.dictionary.at(code), code);
+			mColumns.append(column);
+		}
+	}
+
+	//the row and buffer vectors have to agree, a bad offset would read out of bounds later
+	const int rowCount = mIds.count();
+	ok = ok && mGeometryTypes.count() == rowCount && mFeaturePartBegin.count() == rowCount
+		&& mFeaturePartCount.count() == rowCount && mBoundingBoxes.count() == rowCount
+		&& mRecordBegin.count() == rowCount && mRecordEnd.count() == rowCount
+		&& mAttributeBegin.count() == rowCount && mAttributeEnd.count() == rowCount
+		&& (mFileFields.isEmpty() || mFileFields.count() == mColumns.count())
+		&& mFeatureCodes.count() == rowCount && mGraphicCodes.count() == rowCount
+		&& mPartRingBegin.count() == mPartRingCount.count()
+		&& mRingVertexBegin.count() == mRingVertexCount.count() && mX.count() == mY.count();
+	for (int i = 0; ok && i < rowCount; i++)
+		ok = (i == 0 || mIds.at(i - 1) < mIds.at(i)) && mFeaturePartBegin.at(i) >= 0 && mFeaturePartCount.at(i) >= 0
+			&& mFeaturePartBegin.at(i) + mFeaturePartCount.at(i) <= mPartRingBegin.count()
+			&& mFeatureCodes.at(i) >= -1 && mFeatureCodes.at(i) < mCodes.count()
+			&& mGraphicCodes.at(i) >= -1 && mGraphicCodes.at(i) < mCodes.count();
+	for (int i = 0; ok && i < mPartRingBegin.count(); i++)
+		ok = mPartRingBegin.at(i) >= 0 && mPartRingCount.at(i) >= 0 && mPartRingBegin.at(i) + mPartRingCount.at(i) <= mRingVertexBegin.count();
+	for (int i = 0; ok && i < mRingVertexBegin.count(); i++)
+		ok = mRingVertexBegin.at(i) >= 0 && mRingVertexCount.at(i) >= 0 && mRingVertexBegin.at(i) + mRingVertexCount.at(i) <= mX.count();
+	for (const Column &column : qAsConst(mColumns))
+	{
+		//the buffer of the storage is empty or has a value for each row, the others are empty
+		const Column::Storage storage = column.storage();
+		const int values = storage == Column::Integers ? column.integers.count()
+			: storage == Column::Doubles ? column.doubles.count()
+			: storage == Column::Strings ? column.strings.count()
+			: storage == Column::Dictionary ? column.codes.count()
+			: column.variants.count();
+		ok = ok && column.count() == rowCount && (!column.encoded || column.type == QVariant::String)
+			&& (values == 0 || values == rowCount)
+			&& column.integers.count() + column.doubles.count() + column.strings.count() + column.codes.count() + column.variants.count() == values
+			&& (column.errorTexts.isEmpty() || column.errorTexts.count() == rowCount)
+			&& std::all_of(column.states.constBegin(), column.states.constEnd(), [&column, values](quint8 state)
+			{
+				return state == Column::Null || (state == Column::Value && values > 0) || (state == Column::ConversionError && !column.errorTexts.isEmpty());
+			});
+		for (int row = 0; ok && storage == Column::Dictionary && row < rowCount; row++)
+			ok = column.states.at(row) != Column::Value || (column.codes.at(row) >= 0 && column.codes.at(row) < column.dictionary.count());
+	}
+	for (int code = 0; ok && code < mCodes.count(); code++)
+		mCodeIndex.insert(mCodes.at(code), code);
+
+	if (!ok)
+		*this = QgsVctFeatureStore();
+	return ok;
+}
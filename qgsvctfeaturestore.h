@@ -0,0 +1,331 @@
+#pragma once
+
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsrectangle.h"
+#include "qgswkbtypes.h"
+
+#include <QHash>
+#include <QVector>
+
+#include <memory>
+
+class QDataStream;
+class QgsVctFeatureStore;
+class QgsVctRecordCache;
+
+/**
+ * Decodes single records of the file a store was loaded from, for stores with lazy geometries
+ * or deferred attributes.
+ */
+class QgsVctRecordDecoder
+{
+public:
+	virtual ~QgsVctRecordDecoder() = default;
+
+	//! Reads the record in the byte range [begin, end) of the file into a new row of \a features
+	virtual void decode(qint64 begin, qint64 end, QgsWkbTypes::GeometryType type, QgsVctFeatureStore &features) const = 0;
+	//! Reads the attribute row in the byte range [begin, end) of the file, the values are left as text
+	virtual QgsAttributes decodeAttributes(qint64 begin, qint64 end) const = 0;
+	//! Bytes of the range [begin, end) of the file, for copying records to a new file
+	virtual QByteArray text(qint64 begin, qint64 end) const = 0;
+};
+
+/**
+ * Columnar in-memory storage of the features of a VCT layer.
+ *
+ * Geometries are flattened into shared coordinate buffers: a feature references a range
+ * of parts, a part a range of rings and a ring a range of vertices. Attributes are kept
+ * in one typed column per field: integers, doubles and strings in plain vectors, other types
+ * as variants. String columns with few distinct values keep a dictionary and a code per row
+ * instead, as do the feature and graphic codes of the records. Rows are ordered by feature id,
+ * ids are found by binary search and QgsFeature objects are only built when asked for.
+ *
+ * In lazy mode the readers only leave the byte range of each record and its bounding box; the
+ * coordinates are decoded again from the file when the geometry is asked for and kept in a bounded
+ * cache shared by all copies of the store. Attribute rows can be deferred the same way, they keep
+ * null columns until a value of the row is changed. Column buffers of values are only allocated
+ * for columns holding a value, so a store of deferred records costs a few bytes per row and field.
+ *
+ * All members are Qt containers, so copies are implicitly shared until one side is modified.
+ */
+class QgsVctFeatureStore
+{
+public:
+
+	int count() const { return mIds.count(); }
+	bool isEmpty() const { return mIds.isEmpty(); }
+	QgsFeatureId id(int row) const { return mIds.at(row); }
+	const QVector<QgsFeatureId> &ids() const { return mIds; }
+	//! Row of feature \a id, -1 if it is not stored
+	int row(QgsFeatureId id) const;
+	bool contains(QgsFeatureId id) const { return row(id) >= 0; }
+	//! Largest stored feature id, 0 for an empty store
+	QgsFeatureId maximumId() const { return mIds.isEmpty() ? 0 : mIds.last(); }
+
+	/**
+	 * Appends a feature without geometry and attributes and returns its row.
+	 * Unless \a id is larger than every stored id, normalize() has to be called before looking up ids.
+	 */
+	int addFeature(QgsFeatureId id);
+	//! Sets the feature and graphic code of the record \a row was read from
+	void setRecordCodes(int row, const char *featureCode, int featureCodeSize, const char *graphicCode, int graphicCodeSize);
+	//! Feature code of the record of \a row, empty for features that were not read from a file
+	QByteArray featureCode(int row) const;
+	QByteArray graphicCode(int row) const;
+	//! Sorts the rows by feature id, a later row replaces an earlier row with the same id
+	void normalize();
+	//! Moves the rows of \a other behind the rows of this store, call normalize() afterwards
+	void append(const QgsVctFeatureStore &other);
+	//! Removes the given features, returns the number of removed rows
+	int removeFeatures(const QgsFeatureIds &ids);
+	/**
+	 * Splits the rows into \a count stores, \a parts holds the store of each row or -1 to drop it.
+	 * The stores keep the order of the rows and get their own geometry buffers.
+	 */
+	QVector<QgsVctFeatureStore> partition(const QVector<int> &parts, int count) const;
+
+	/**
+	 * Geometry building for the readers: beginGeometry() replaces the geometry of \a row,
+	 * the following parts, rings and vertices belong to it until endGeometry().
+	 */
+	void beginGeometry(int row, QgsWkbTypes::GeometryType type, qint64 recordBegin = -1);
+	void beginPart();
+	void beginRing();
+	inline void addVertex(double x, double y);
+	void endGeometry(qint64 recordEnd = -1);
+
+	/**
+	 * In lazy mode geometries built with a record range only keep their bounding box,
+	 * setDecoder() has to be called before they are read.
+	 */
+	void setLazyGeometries(bool lazy) { mLazy = lazy; }
+	//! Leaves the attributes of \a row in the byte range [begin, end) of the file, to be decoded when asked for
+	void deferAttributes(int row, qint64 begin, qint64 end);
+	//! Sets the decoder of lazy geometries and deferred attributes and the budget of their cache, in bytes
+	void setDecoder(const std::shared_ptr<const QgsVctRecordDecoder> &decoder, qint64 cacheBudget);
+	bool hasLazyGeometries() const;
+	bool hasDeferredAttributes() const;
+	//! Decodes all lazy geometries and deferred attributes, the store no longer needs the file afterwards
+	void loadRecords();
+
+	/**
+	 * Saving keeps the store lazy: the writer copies the text of the lazy records, moves them to their
+	 * range in the new file and replaceFile() points the store at the decoder of that file.
+	 */
+	bool hasLazyGeometry(int row) const { return mRecordBegin.at(row) >= 0; }
+	bool hasDeferredAttributes(int row) const { return mAttributeBegin.at(row) >= 0; }
+	//! Text of the lazy geometry record of \a row, from its id line to its last coordinate line
+	QByteArray recordText(int row) const;
+	//! Text of the deferred attribute row of \a row, empty when the fields changed since the file was read
+	QByteArray attributeText(int row) const;
+	void moveRecord(int row, qint64 begin, qint64 end);
+	void moveAttributes(int row, qint64 begin, qint64 end);
+	//! Decodes the moved records from the written file, whose attribute rows have the fields of the store
+	void replaceFile(const std::shared_ptr<const QgsVctRecordDecoder> &decoder);
+
+	/**
+	 * Estimated bytes held by the store, for memory accounting. Copies share their buffers until
+	 * one side is modified, each of them counts the shared buffers. The estimates scan the string
+	 * columns and are linear in the number of rows.
+	 */
+	qint64 coordinateBytes() const;
+	qint64 attributeBytes() const;
+	//! Bytes of the sorted ids, the index of the rows
+	qint64 indexBytes() const;
+	//! Bytes held by the cache of decoded records, which is shared with the copies of the store
+	qint64 cachedBytes() const;
+	//! Empties the cache of decoded records, they are decoded from the file again when asked for
+	void clearCache() const;
+
+	QgsWkbTypes::GeometryType geometryType(int row) const { return static_cast<QgsWkbTypes::GeometryType>(mGeometryTypes.at(row)); }
+	bool hasGeometry(int row) const;
+	QgsRectangle boundingBox(int row) const { return mBoundingBoxes.at(row); }
+	//! Builds the multi geometry of \a row, a null geometry for features without one
+	QgsGeometry geometry(int row) const;
+	void setGeometry(int row, const QgsGeometry &geometry);
+	void clearGeometry(int row);
+	//! Number of vertices in the coordinate buffers, including the ones of replaced geometries
+	int vertexCount() const { return mX.count(); }
+
+	/**
+	 * Direct access to the buffers of geometries that are not lazy: a row references a range of
+	 * parts, a part a range of rings and a ring a range of vertices.
+	 */
+	int featurePartBegin(int row) const { return mFeaturePartBegin.at(row); }
+	int featurePartCount(int row) const { return mFeaturePartCount.at(row); }
+	int partRingBegin(int part) const { return mPartRingBegin.at(part); }
+	int partRingCount(int part) const { return mPartRingCount.at(part); }
+	int ringVertexBegin(int ring) const { return mRingVertexBegin.at(ring); }
+	int ringVertexCount(int ring) const { return mRingVertexCount.at(ring); }
+	double x(int vertex) const { return mX.at(vertex); }
+	double y(int vertex) const { return mY.at(vertex); }
+
+	int fieldCount() const { return mColumns.count(); }
+	QVariant::Type fieldType(int field) const { return mColumns.at(field).type; }
+	//! Adds or drops columns to match \a types and converts the columns whose type changed
+	void setFieldTypes(const QVector<QVariant::Type> &types);
+	void addField(QVariant::Type type);
+	void removeField(int field);
+	//! Value of \a field in \a row, a null variant of the field type for nulls and conversion errors
+	QVariant attribute(int row, int field) const;
+	QgsAttributes attributes(int row) const;
+	//! Converts \a value to the field type, a value that does not convert is kept as a conversion error
+	void setAttribute(int row, int field, const QVariant &value);
+	//! Sets the attributes of \a row, missing values are set to null and extra values are added as string columns
+	void setAttributes(int row, const QgsAttributes &attributes);
+
+	//! Whether the value of \a field in \a row could not be converted to the field type
+	bool hasConversionError(int row, int field) const;
+	//! Text of a value that could not be converted, it is written back unchanged
+	QString conversionErrorText(int row, int field) const;
+	//! Number of values in the columns that could not be converted, deferred rows are not counted
+	int conversionErrorCount() const;
+
+	//! Switches string columns with few distinct values to dictionary storage, unless attributes are deferred
+	void encodeStrings();
+	bool isDictionaryEncoded(int field) const;
+	/**
+	 * Rows whose value of \a field is \a value, compared on the codes of a dictionary encoded column.
+	 * Returns false for other columns.
+	 */
+	bool rowsEqualTo(int field, const QString &value, QVector<int> &rows) const;
+	//! Adds the number of rows per distinct value of a dictionary encoded column to \a counts, returns false for other columns
+	bool valueCounts(int field, QHash<QVariant, int> &counts) const;
+
+	/**
+	 * Converts \a value to \a type in place, returns false if it cannot be represented.
+	 * Numbers in strings may be surrounded by blanks. Safe to call from any thread.
+	 */
+	static bool convertValue(QVariant &value, QVariant::Type type);
+
+	//! Fills \a feature with the id, geometry and attributes of \a row
+	void feature(int row, QgsFeature &feature) const;
+
+	/**
+	 * Binary serialization for the sidecar cache. Numeric buffers are copied as raw blocks in the
+	 * byte order of the host, readers have to check that the data was written on a compatible host.
+	 */
+	void writeTo(QDataStream &stream) const;
+	//! Replaces the content of the store, returns false and leaves the store empty on malformed data
+	bool readFrom(QDataStream &stream);
+
+private:
+
+	void releaseGeometry(int row);
+	QgsGeometry decodeGeometry(int row) const;
+	//! Attribute row of \a row as read from the file, in the order of the file fields
+	QgsAttributes decodeAttributes(int row) const;
+	//! Value of \a field in the deferred \a row, \a error is set if it does not convert to the field type
+	QVariant deferredAttribute(const QgsAttributes &values, int field, bool *error = nullptr, QString *text = nullptr) const;
+	//! Stores the decoded attributes of \a row in the columns
+	void loadAttributes(int row);
+	//! Keeps the rows flagged in \a keep, in order
+	void keepRows(const QVector<bool> &keep);
+	//! Rebuilds the geometry buffers without the ranges of replaced or removed geometries
+	void compactGeometries();
+
+	//rows
+	QVector<QgsFeatureId> mIds;
+	QVector<quint8> mGeometryTypes;
+	QVector<int> mFeaturePartBegin;
+	QVector<int> mFeaturePartCount;
+	QVector<QgsRectangle> mBoundingBoxes;
+	//file range of lazy geometries, -1 for geometries in the buffers
+	QVector<qint64> mRecordBegin;
+	QVector<qint64> mRecordEnd;
+	//file range of deferred attribute rows, -1 for rows in the columns
+	QVector<qint64> mAttributeBegin;
+	QVector<qint64> mAttributeEnd;
+	//file field of each column for deferred rows, empty while they match
+	QVector<int> mFileFields;
+
+	//geometry buffers
+	QVector<int> mPartRingBegin;
+	QVector<int> mPartRingCount;
+	QVector<int> mRingVertexBegin;
+	QVector<int> mRingVertexCount;
+	QVector<double> mX;
+	QVector<double> mY;
+	int mGarbageVertices = 0;
+
+	//one column per field, only the buffer of the storage of the column type is used, it stays empty until it holds a value
+	struct Column
+	{
+		enum State : quint8
+		{
+			Null = 0,
+			Value,
+			ConversionError,
+		};
+		enum Storage
+		{
+			Integers,
+			Doubles,
+			Strings,
+			Dictionary,
+			Variants,
+		};
+
+		QVariant::Type type = QVariant::String;
+		QVector<quint8> states;
+		QVector<qint64> integers;
+		QVector<double> doubles;
+		QVector<QString> strings;
+		QVector<QVariant> variants;
+		//dictionary encoded strings
+		bool encoded = false;
+		QVector<QString> dictionary;
+		QHash<QString, int> dictionaryIndex;
+		QVector<int> codes;
+		//text of values that could not be converted, empty as long as there is none
+		QVector<QString> errorTexts;
+
+		static Storage typeStorage(QVariant::Type type);
+		//! State of \a value stored in a column of \a type, \a converted receives the converted value
+		static State valueState(const QVariant &value, QVariant::Type type, QVariant &converted);
+		Storage storage() const { return encoded ? Dictionary : typeStorage(type); }
+		int count() const { return states.count(); }
+		QVariant value(int row) const;
+		//! The value, or the text of a conversion error
+		QVariant sourceValue(int row) const;
+		void setValue(int row, const QVariant &value);
+		void resize(int count);
+		void append(const Column &other);
+		void copyRow(int from, int to);
+		void selectRows(const QVector<int> &rows);
+		void convert(QVariant::Type type);
+		bool encode();
+		void decode();
+	};
+	QVector<Column> mColumns;
+
+	//feature and graphic codes of the records, -1 for none
+	QVector<int> mFeatureCodes;
+	QVector<int> mGraphicCodes;
+	QVector<QByteArray> mCodes;
+	QHash<QByteArray, int> mCodeIndex;
+	int mLastCode = -1;
+	int internCode(const char *code, int size);
+
+	//lazy geometries and deferred attributes
+	bool mLazy = false;
+	std::shared_ptr<const QgsVctRecordDecoder> mDecoder;
+	std::shared_ptr<QgsVctRecordCache> mRecordCache;
+
+	//geometry being built
+	int mBuildRow = -1;
+	bool mBuildLazy = false;
+	bool mBuildHasParts = false;
+	QgsRectangle mBuildBox;
+};
+
+inline void QgsVctFeatureStore::addVertex(double x, double y)
+{
+	mBuildBox.combineExtentWith(x, y);
+	if (mBuildLazy)
+		return;
+	mX.append(x);
+	mY.append(y);
+	++mRingVertexCount.last();
+}
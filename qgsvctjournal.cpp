@@ -0,0 +1,135 @@
+#include "qgsvctjournal.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+
+namespace
+{
+	const quint32 JOURNAL_MAGIC = 0x56435444;//"VCTJ"
+	const quint32 JOURNAL_VERSION = 1;
+}
+
+QgsVctJournal::QgsVctJournal(const QString &vctPath, const QString &layerName)
+	: mVctPath(vctPath)
+	, mPath(layerName.isEmpty() ? vctPath + QStringLiteral(".journal") : QStringLiteral("%1.%2.journal").arg(vctPath, layerName))
+{
+}
+
+bool QgsVctJournal::isEmpty() const
+{
+	return !QFile::exists(mPath);
+}
+
+qint64 QgsVctJournal::size() const
+{
+	return QFileInfo(mPath).size();
+}
+
+QByteArray QgsVctJournal::vctSignature() const
+{
+	const QFileInfo info(mVctPath);
+	QByteArray signature;
+	QDataStream stream(&signature, QIODevice::WriteOnly);
+	stream << info.size() << info.lastModified().toMSecsSinceEpoch();
+	return signature;
+}
+
+bool QgsVctJournal::read(QList<Entry> &entries, QString &error)
+{
+	entries.clear();
+	QFile file(mPath);
+	if (!file.open(QIODevice::ReadOnly))
+		return true;
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_9);
+	quint32 magic = 0;
+	quint32 version = 0;
+	QByteArray signature;
+	stream >> magic >> version >> signature;
+	if (stream.status() != QDataStream::Ok || magic != JOURNAL_MAGIC || version != JOURNAL_VERSION)
+	{
+		mStale = true;
+		error = QObject::tr("Unsupported edit journal %1").arg(mPath);
+		return false;
+	}
+	if (signature != vctSignature())
+	{
+		mStale = true;
+		error = QObject::tr("Edit journal %1 does not match %2, it was ignored").arg(mPath, mVctPath);
+		return false;
+	}
+
+	qint64 validSize = file.pos();
+	while (!stream.atEnd())
+	{
+		qint32 operation = 0;
+		QByteArray payload;
+		stream >> operation >> payload;
+		if (stream.status() != QDataStream::Ok)
+			break;
+		entries.append(Entry{ static_cast<Operation>(operation), payload });
+		validSize = file.pos();
+	}
+	file.close();
+
+	//drop an entry cut short, the next one is appended behind the last complete entry
+	if (validSize < QFileInfo(mPath).size())
+		QFile::resize(mPath, validSize);
+	return true;
+}
+
+bool QgsVctJournal::append(Operation operation, const QByteArray &payload)
+{
+	if (mStale && !clear())
+		return false;
+
+	QFile file(mPath);
+	const bool start = !file.exists();
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_9);
+	if (start)
+		stream << JOURNAL_MAGIC << JOURNAL_VERSION << vctSignature();
+	stream << qint32(operation) << payload;
+	return stream.status() == QDataStream::Ok && file.flush();
+}
+
+bool QgsVctJournal::clear()
+{
+	mStale = false;
+	return !QFile::exists(mPath) || QFile::remove(mPath);
+}
+
+bool QgsVctJournal::matchesFile() const
+{
+	QFile file(mPath);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_9);
+	quint32 magic = 0;
+	quint32 version = 0;
+	QByteArray signature;
+	stream >> magic >> version >> signature;
+	return stream.status() == QDataStream::Ok && magic == JOURNAL_MAGIC && version == JOURNAL_VERSION && signature == vctSignature();
+}
+
+bool QgsVctJournal::updateSignature()
+{
+	QFile file(mPath);
+	if (!file.open(QIODevice::ReadWrite))
+		return false;
+
+	//the signature has a fixed size, it is overwritten in place behind magic and version
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_9);
+	file.seek(2 * sizeof(quint32));
+	stream << vctSignature();
+	return stream.status() == QDataStream::Ok && file.flush();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QList>
+#include <QString>
+
+/**
+ * Append-only log of the edits made to a VCT file since it was last written.
+ *
+ * Each edit is appended as one entry in O(edit size); the provider replays the entries after
+ * loading the file and writes the whole file again (compaction) on demand, above a size
+ * threshold and when it is closed. The journal starts with the size and modification time
+ * of the VCT file it applies to and is ignored when the file no longer matches. An entry cut
+ * short by a crash and everything after it are dropped.
+ */
+class QgsVctJournal
+{
+public:
+
+	enum Operation
+	{
+		AddFeatures = 1,
+		DeleteFeatures,
+		ChangeAttributeValues,
+		ChangeGeometryValues,
+		AddAttributes,
+		RenameAttributes,
+		DeleteAttributes,
+	};
+
+	struct Entry
+	{
+		Operation operation;
+		QByteArray payload;
+	};
+
+	/**
+	 * Journal of the edits to the feature class \a layerName of \a vctPath, the only
+	 * one or the whole file when the name is empty.
+	 */
+	explicit QgsVctJournal(const QString &vctPath = QString(), const QString &layerName = QString());
+
+	//! Location of the journal, next to the VCT file
+	QString path() const { return mPath; }
+
+	//! Returns true when there is no journal for the file
+	bool isEmpty() const;
+
+	//! Size of the journal file in bytes
+	qint64 size() const;
+
+	/**
+	 * Reads the entries recorded for the current VCT file.
+	 * Returns false and sets \a error when the journal exists but does not apply to the file.
+	 */
+	bool read(QList<Entry> &entries, QString &error);
+
+	//! Appends an entry, the journal is started if it does not exist or is stale
+	bool append(Operation operation, const QByteArray &payload);
+
+	//! Removes the journal, once its edits are in the VCT file
+	bool clear();
+
+	//! Returns true when the journal exists and was started for the current VCT file
+	bool matchesFile() const;
+
+	/**
+	 * Makes the journal apply to the current VCT file. Used after another feature class was written
+	 * into the file, which leaves the features this journal applies to unchanged.
+	 */
+	bool updateSignature();
+
+	template <typename T>
+	static QByteArray encode(const T &value)
+	{
+		QByteArray payload;
+		QDataStream stream(&payload, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_9);
+		stream << value;
+		return payload;
+	}
+
+	template <typename T>
+	static bool decode(const QByteArray &payload, T &value)
+	{
+		QDataStream stream(payload);
+		stream.setVersion(QDataStream::Qt_5_9);
+		stream >> value;
+		return stream.status() == QDataStream::Ok;
+	}
+
+private:
+
+	//! Size and modification time of the VCT file
+	QByteArray vctSignature() const;
+
+	QString mVctPath;
+	QString mPath;
+	bool mStale = false;
+};
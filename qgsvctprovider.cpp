@@ -5,10 +5,39 @@
 #include "qgsmultilinestring.h"
 #include "qgslinestring.h"
 #include "qgsmessagelog.h"
+#include "qgssettings.h"
+#include "qgsexpressioncontextutils.h"
+#include "qgsexpressionnodeimpl.h"
+#include "qgsproject.h"
+
+#include <QMutexLocker>
+#include <QUrl>
+#include <QtConcurrentRun>
+
+#include <algorithm>
 
 const QString QgsVctProvider::VCT_PROVIDER_KEY = QStringLiteral("vctfile");
 const QString QgsVctProvider::VCT_PROVIDER_DESCRIPTION = QStringLiteral("VCT data provider");
 
+//the edit journal is written into the file once it grows above this size
+static const qint64 JOURNAL_COMPACTION_SIZE = 64 * 1024 * 1024;
+//quiet time in milliseconds after an edit before a background save starts
+static const int BACKGROUND_SAVE_DELAY = 500;
+//estimated bytes of a feature in the R-tree of the spatial index, with its share of the nodes
+static const qint64 SPATIAL_INDEX_ENTRY_SIZE = 128;
+
+namespace
+{
+	//usage last published by every VCT layer of the process, checked against the memory budget
+	struct QgsVctMemoryEntry
+	{
+		QgsVctProvider *provider = nullptr;
+		QgsVctProvider::MemoryUsage usage;
+	};
+	QMutex sMemoryMutex;
+	QHash<const QgsVctProvider *, QgsVctMemoryEntry> sMemoryUsage;
+}
+
 QgsVctProvider::QgsVctProvider(const QString &uri, const ProviderOptions &options)
 	: QgsVectorDataProvider(uri, options)
 {
@@ -38,12 +67,149 @@ QgsVctProvider::QgsVctProvider(const QString &uri, const ProviderOptions &option
 	);
 
 	mUri = uri;
-	readData(mUri);
-	mNextFeatureId = featureCount() + 1;
+	QString layerName;
+	decodeUri(uri, mPath, layerName);
+
+	//the layers of one file share a single parse, in the background only the feature classes are read here
+	QgsSettings settings;
+	if (settings.value(QStringLiteral("providers/vct/backgroundLoading"), false).toBool())
+		mDataset = QgsVctDataset::openInBackground(mPath);
+	else
+		mDataset = QgsVctDataset::open(mPath);
+	if (!mDataset->error().isEmpty())
+		pushError(mDataset->error());
+	mLayerIndex = mDataset->layerIndex(layerName);
+	if (mLayerIndex < 0)
+	{
+		pushError(tr("VCT file %1 has no feature class %2").arg(mPath, layerName));
+		mWkbType = QgsWkbTypes::Unknown;
+		return;
+	}
+	const QgsVctLayerContent layer = mDataset->layer(mLayerIndex);
+	mWkbType = layer.wkbType;
+	mGeometryType = layer.geometryType;
+	mCrs = mDataset->crs();
+	mFields = layer.fields;
+
+	mJournal = QgsVctJournal(mPath, mDataset->journalName(mLayerIndex));
+	mJournalEnabled = settings.value(QStringLiteral("providers/vct/journal"), true).toBool();
+
+	mBackgroundSaving = settings.value(QStringLiteral("providers/vct/backgroundSaving"), false).toBool();
+	mSaveTimer.setSingleShot(true);
+	mSaveTimer.setInterval(BACKGROUND_SAVE_DELAY);
+	connect(&mSaveTimer, &QTimer::timeout, this, &QgsVctProvider::startBackgroundSave);
+	connect(&mSaveWatcher, &QFutureWatcher<QString>::finished, this, &QgsVctProvider::backgroundSaveFinished);
+
+	//in MiB for all VCT layers of the process, 0 for none
+	mMemoryBudget = qint64(settings.value(QStringLiteral("providers/vct/memoryBudget"), 0).toInt()) * 1024 * 1024;
+	{
+		QMutexLocker locker(&sMemoryMutex);
+		sMemoryUsage[this].provider = this;
+	}
+
+	mLoading = true;
+	const QFuture<void> loading = mDataset->loading();
+	if (loading.isFinished())
+	{
+		finishLoading(false);
+		return;
+	}
+	connect(&mLoadWatcher, &QFutureWatcher<void>::finished, this, [this]() { finishLoading(true); });
+	mLoadWatcher.setFuture(loading);
+}
+
+void QgsVctProvider::finishLoading(bool notify)
+{
+	if (!mLoading)
+		return;
+	mLoading = false;
+	mLoadFailed = !mDataset->error().isEmpty();
+	if (notify && mLoadFailed)
+		pushError(mDataset->error());
+
+	mRevision = mDataset->layerRevision(mLayerIndex);
+	const QgsVctLayerContent layer = mDataset->layer(mLayerIndex);
+	mFeatures = layer.features;
+	mStoreUsageValid = false;
+
+	//ids stay unique over the whole file
+	mNextFeatureId = std::max(mNextFeatureId, mDataset->maximumId() + 1);
+	const int conversionErrors = mFeatures.conversionErrorCount();
+	if (conversionErrors > 0)
+		QgsMessageLog::logMessage(tr("%1 attribute values of %2 do not match the type of their field and are read as null").arg(conversionErrors).arg(mUri), tr("VCT"), Qgis::Warning);
+	//the journal stays for the next complete load
+	if (!mLoadFailed)
+		replayJournal();
+
+	//a subset string or spatial index set during the load was applied to no features
+	rebuildSubsetIndex();
+	const bool spatialIndex = mSpatialIndex != nullptr || QgsSettings().value(QStringLiteral("providers/vct/spatialIndex"), true).toBool();
+	delete mSpatialIndex;
+	mSpatialIndex = nullptr;
+	if (spatialIndex)
+		createSpatialIndex();
+	updateMemoryUsage();
+
+	if (notify)
+	{
+		clearMinMaxCache();
+		emit fullExtentCalculated();
+		emit dataChanged();
+	}
+}
+
+bool QgsVctProvider::waitForLoaded()
+{
+	if (mLoading)
+	{
+		mLoadWatcher.waitForFinished();
+		finishLoading(true);
+	}
+	return !mLoadFailed;
+}
+
+bool QgsVctProvider::claimLayer()
+{
+	if (!waitForLoaded())
+		return false;
+	//edits replayed from the journal only change the store of this provider
+	if (mReplayingJournal)
+		return true;
+	if (!mEditor)
+		mEditor = mDataset->claimLayer(mLayerIndex, this, mRevision);
+	if (!mEditor)
+		pushError(tr("Layer %1 of VCT file %2 is edited through another layer of the same feature class").arg(mDataset->layerNames().value(mLayerIndex), mPath));
+	return mEditor;
+}
+
+QgsFeedback *QgsVctProvider::loadingFeedback() const
+{
+	return mDataset ? mDataset->loadingFeedback() : nullptr;
 }
 
 QgsVctProvider::~QgsVctProvider()
 {
+	{
+		QMutexLocker locker(&sMemoryMutex);
+		sMemoryUsage.remove(this);
+	}
+	//backgroundSaveFinished() does not run anymore, a failed or scheduled save is written here
+	mSaveWatcher.waitForFinished();
+	if (mSaveWatcher.future().resultCount() > 0 && !mSaveWatcher.result().isEmpty())
+		mEditsPending = true;
+	if (mSaveTimer.isActive())
+		mEditsPending = true;
+
+	//leave a self-contained VCT file for other applications, a journal not replayed yet stays for the next load
+	if (!mLoading && !mLoadFailed && isValid() && (mEditsPending || (!mJournal.isEmpty() && !mJournalStale)) &&
+		(mEditor || mDataset->claimLayer(mLayerIndex, this, mRevision)))
+	{
+		mEditor = true;
+		compactJournal();
+	}
+	if (mEditor)
+		mDataset->releaseLayer(mLayerIndex, this, mEditsPending || !mJournal.isEmpty());
+
 	if (mSpatialIndex != nullptr)
 		delete mSpatialIndex;
 }
@@ -65,12 +231,91 @@ QgsFeatureIterator QgsVctProvider::getFeatures(const QgsFeatureRequest &request)
 
 QString QgsVctProvider::dataComment() const
 {
-	QString comment;
-	for (int i = 0; i < mComments.size(); i++)
+	return mDataset->comments().join(QString());
+}
+
+QString QgsVctProvider::htmlMetadata() const
+{
+	//loads and saves of the file followed by the reads of this layer
+	QString html;
+	if (mDataset)
+		html += mDataset->profile().toHtml();
+	html += mProfile->toHtml();
+
+	const MemoryUsage usage = memoryUsage();
+	auto megabytes = [](qint64 bytes) { return QString::number(double(bytes) / (1024 * 1024), 'f', 1); };
+	html += QStringLiteral("<tr><td class=\"highlight\">%1</td><td>%2</td></tr>\n").arg(tr("Memory"),
+		tr("%1 MB: coordinates %2 MB, attributes %3 MB, indexes %4 MB, caches %5 MB").arg(megabytes(usage.total()),
+			megabytes(usage.coordinates), megabytes(usage.attributes), megabytes(usage.indexes), megabytes(usage.caches)));
+	return html;
+}
+
+QgsVctProvider::MemoryUsage QgsVctProvider::memoryUsage() const
+{
+	//scanning the string columns is linear, the store is only measured again after an edit
+	if (!mStoreUsageValid)
+	{
+		mStoreUsage.coordinates = mFeatures.coordinateBytes();
+		mStoreUsage.attributes = mFeatures.attributeBytes();
+		mStoreUsage.indexes = mFeatures.indexBytes();
+		mStoreUsageValid = true;
+	}
+	MemoryUsage usage = mStoreUsage;
+	if (mSpatialIndex != nullptr)
+		usage.indexes += qint64(mFeatures.count()) * SPATIAL_INDEX_ENTRY_SIZE;
+	usage.indexes += qint64(mSubsetIndex.capacity()) * qint64(sizeof(QgsFeatureId));
+	usage.caches = mFeatures.cachedBytes() + mStatistics.memoryUsage() + mExtentIndex.memoryUsage();
+	return usage;
+}
+
+void QgsVctProvider::releaseCaches() const
+{
+	mFeatures.clearCache();
+	mStatistics.clear();
+	mExtentIndex.clear();
+
+	QMutexLocker locker(&sMemoryMutex);
+	const QHash<const QgsVctProvider *, QgsVctMemoryEntry>::iterator own = sMemoryUsage.find(this);
+	if (own != sMemoryUsage.end())
+		own->usage.caches = 0;
+}
+
+void QgsVctProvider::updateMemoryUsage() const
+{
+	const MemoryUsage usage = memoryUsage();
+	QMutexLocker locker(&sMemoryMutex);
+	const QHash<const QgsVctProvider *, QgsVctMemoryEntry>::iterator own = sMemoryUsage.find(this);
+	if (own == sMemoryUsage.end())
+		return;
+	own->usage = usage;
+	if (mMemoryBudget <= 0)
+		return;
+
+	qint64 total = 0;
+	QVector<QPair<qint64, const QgsVctProvider *>> caches;
+	for (QHash<const QgsVctProvider *, QgsVctMemoryEntry>::const_iterator it = sMemoryUsage.constBegin(); it != sMemoryUsage.constEnd(); ++it)
+	{
+		total += it->usage.total();
+		//the caches of this layer were just built for a request, dropping them would only rebuild them
+		if (it.key() != this && it->usage.caches > 0)
+			caches.append(qMakePair(it->usage.caches, it.key()));
+	}
+	if (total <= mMemoryBudget)
+		return;
+
+	//largest caches first, each layer releases them on its own thread
+	std::sort(caches.begin(), caches.end(), [](const QPair<qint64, const QgsVctProvider *> &a, const QPair<qint64, const QgsVctProvider *> &b)
+	{
+		return a.first > b.first;
+	});
+	for (const QPair<qint64, const QgsVctProvider *> &cache : caches)
 	{
-		comment += mComments[i];
+		if (total <= mMemoryBudget)
+			break;
+		total -= cache.first;
+		QgsVctProvider *provider = sMemoryUsage.value(cache.second).provider;
+		QMetaObject::invokeMethod(provider, [provider]() { provider->releaseCaches(); }, Qt::QueuedConnection);
 	}
-	return comment;
 }
 
 QgsWkbTypes::Type QgsVctProvider::wkbType() const
@@ -80,6 +325,11 @@ QgsWkbTypes::Type QgsVctProvider::wkbType() const
 
 long QgsVctProvider::featureCount() const
 {
+	//unknown until the file is loaded
+	if (mLoading)
+		return -1;
+	if (mUseSubsetIndex)
+		return mSubsetIndex.count();
 	return mFeatures.count();
 }
 
@@ -90,459 +340,243 @@ QgsFields QgsVctProvider::fields() const
 
 QgsVectorDataProvider::Capabilities QgsVctProvider::capabilities() const
 {
+	//a layer opened twice is edited through one provider, the others are read-only
+	if (mLoadFailed || (!mEditor && mLayerIndex >= 0 && !mDataset->isClaimable(mLayerIndex, mRevision)))
+		return CreateSpatialIndex;
 	return AddFeatures | DeleteFeatures | ChangeGeometries |
-		ChangeAttributeValues | AddAttributes | DeleteAttributes | RenameAttributes;
+		ChangeAttributeValues | AddAttributes | DeleteAttributes | RenameAttributes |
+		CreateSpatialIndex;
 }
 
 bool QgsVctProvider::createSpatialIndex()
 {
-	return false;
+	if (mSpatialIndex == nullptr)
+	{
+		mSpatialIndex = new QgsSpatialIndex();
+		//the store keeps the bounding boxes, no geometry has to be built
+		for (int row = 0; row < mFeatures.count(); row++)
+		{
+			if (mFeatures.hasGeometry(row))
+				mSpatialIndex->addFeature(mFeatures.id(row), mFeatures.boundingBox(row));
+		}
+	}
+	return true;
 }
 
 QgsFeatureSource::SpatialIndexPresence QgsVctProvider::hasSpatialIndex() const
 {
-	return QgsFeatureSource::SpatialIndexNotPresent;
-}
-
-QString QgsVctProvider::name() const
-{
-	return VCT_PROVIDER_KEY;
+	return mSpatialIndex ? QgsFeatureSource::SpatialIndexPresent : QgsFeatureSource::SpatialIndexNotPresent;
 }
 
-QString QgsVctProvider::description() const
+void QgsVctProvider::removeFromSpatialIndex(int row)
 {
-	return VCT_PROVIDER_DESCRIPTION;
+	if (mSpatialIndex == nullptr || !mFeatures.hasGeometry(row))
+		return;
+	//the index locates entries by the bounding box of the geometry
+	QgsFeature feature(mFeatures.id(row));
+	feature.setGeometry(QgsGeometry::fromRect(mFeatures.boundingBox(row)));
+	mSpatialIndex->deleteFeature(feature);
 }
 
-QgsRectangle QgsVctProvider::extent() const
+void QgsVctProvider::addToSpatialIndex(int row)
 {
-	return mExtent;
+	if (mSpatialIndex != nullptr && mFeatures.hasGeometry(row))
+		mSpatialIndex->addFeature(mFeatures.id(row), mFeatures.boundingBox(row));
 }
 
-bool QgsVctProvider::isValid() const
+QString QgsVctProvider::name() const
 {
-	//return mLayerValid;
-	return (mWkbType != QgsWkbTypes::Unknown);
+	return VCT_PROVIDER_KEY;
 }
 
-QgsCoordinateReferenceSystem QgsVctProvider::crs() const
+QString QgsVctProvider::description() const
 {
-	return mCrs;
+	return VCT_PROVIDER_DESCRIPTION;
 }
 
-bool QgsVctProvider::setSubsetString(const QString &subset, bool updateFeatureCount)
+QgsRectangle QgsVctProvider::extent() const
 {
-	return false;
-}
-
-void QgsVctProvider::readData(QString uri)
-{
-	//read Data
-	QFile vctFile(uri);
-	vctFile.open(QIODevice::ReadOnly);
-	QTextStream vctStream(&vctFile);
-	vctStream.setCodec(QTextCodec::codecForName("UTF-8"));
-	QString extra = vctStream.readLine();
-	while (!vctStream.atEnd())
-	{
-		if (extra.contains("CommentBegin"))
-			readComment(vctStream);
-		else if (extra.contains("HeadBegin"))
-			readHead(vctStream);
-		else if (extra.contains("FeatureCodeBegin"))
-			readFeatureCode(vctStream);
-		else if (extra.contains("TableStructureBegin"))
-			readTableStructure(vctStream);
-		else if (extra.contains("PointBegin"))
-			readPoint(vctStream);
-		else if (extra.contains("LineBegin"))
-			readLine(vctStream);
-		else if (extra.contains("PolygonBegin"))
-			readPolygon(vctStream);
-		else if (extra.contains("SolidBegin"))
-			readSolid(vctStream);
-		else if (extra.contains("AggregationBegin"))
-			readAggregation(vctStream);
-		else if (extra.contains("AnnotationBegin"))
-			readAnnotation(vctStream);
-		else if (extra.contains("TopologyBegin"))
-			readTopology(vctStream);
-		else if (extra.contains("AttributeBegin"))
-			readAttribute(vctStream);
-		else if (extra.contains("StyleBegin"))
-			readStyle(vctStream);
-		extra = vctStream.readLine();
-	}
-	vctFile.close();
-}
-
-void QgsVctProvider::readComment(QTextStream &stream)
-{
-	QString comment = "";
-	QString extra = stream.readLine();
-	while (!extra.contains("CommentEnd"))
-	{
-		comment += extra;
-		extra = stream.readLine();
-	}
-	mComments.append(comment);
-}
-
-void QgsVctProvider::readHead(QTextStream &stream)
-{
-	QString extra = stream.readLine();
-	while (!extra.contains("HeadEnd"))
-	{
-		QStringList list = extra.split(':');
-		QString key = list[0];
-		QString value = list[1];
-		mHead.append(extra);
-		if (key.contains("Spheroid"))
+	//fullExtentCalculated() follows the load
+	if (mLoading)
+		return QgsRectangle();
+	if (!mExtentIndex.isValid())
+	{
+		QVector<QgsFeatureId> ids;
+		QVector<QgsRectangle> boxes;
+		if (mUseSubsetIndex)
 		{
-			QStringList values = value.split(',');
-			//QgsMessageLog::logMessage("spheroidValues[0]: " + values[0], "vct", Qgis::Critical, true);
-			if (values[0].contains("中国2000国家大地"))
+			for (QgsFeatureId id : mSubsetIndex)
 			{
-				mCrs = QgsCoordinateReferenceSystem(QStringLiteral("EPSG:4526"));
+				int row = mFeatures.row(id);
+				if (row >= 0 && mFeatures.hasGeometry(row))
+				{
+					ids.append(id);
+					boxes.append(mFeatures.boundingBox(row));
+				}
 			}
-			else if (values[0].contains("克拉索夫斯基(1940)"))
-				mCrs = QgsCoordinateReferenceSystem(QStringLiteral("EPSG:4024"));
-		}
-		else if (key.contains("ExtentMin"))
-		{
-			QStringList values = value.split(',');
-			mExtent.setXMinimum(values[0].toDouble());
-			mExtent.setYMinimum(values[1].toDouble());
 		}
-		else if (key.contains("ExtentMax"))
+		else
 		{
-			QStringList values = value.split(',');
-			mExtent.setXMaximum(values[0].toDouble());
-			mExtent.setYMaximum(values[1].toDouble());
+			//the store keeps rows in ascending id order
+			for (int row = 0; row < mFeatures.count(); row++)
+			{
+				if (mFeatures.hasGeometry(row))
+				{
+					ids.append(mFeatures.id(row));
+					boxes.append(mFeatures.boundingBox(row));
+				}
+			}
 		}
-		extra = stream.readLine();
+		mExtentIndex.build(ids, boxes);
+		const QgsRectangle extent = mExtentIndex.extent();
+		updateMemoryUsage();
+		return extent;
 	}
+	return mExtentIndex.extent();
 }
 
-void QgsVctProvider::readFeatureCode(QTextStream &stream)
+void QgsVctProvider::updateExtentIndex(int row)
 {
-	QStringList values = stream.readLine().split(',');
-	mFeatureTypeCode = values[0];
-	mFeatureTypeName = values[1];
-	QString geometryType = values[2];
-	mAttributeTableName = values[3];
-	if (geometryType.contains("Point"))
-	{
-		mWkbType = QgsWkbTypes::MultiPoint;
-		mGeometryType = QgsWkbTypes::PointGeometry;
-	}
-	else if (geometryType.contains("Line"))
-	{
-		mWkbType = QgsWkbTypes::MultiLineString;
-		mGeometryType = QgsWkbTypes::LineGeometry;
-	}
-	else if (geometryType.contains("Polygon"))
-	{
-		mWkbType = QgsWkbTypes::MultiPolygon;
-		mGeometryType = QgsWkbTypes::PolygonGeometry;
-	}
+	const QgsFeatureId id = mFeatures.id(row);
+	const bool visible = !mUseSubsetIndex || std::binary_search(mSubsetIndex.constBegin(), mSubsetIndex.constEnd(), id);
+	if (visible && mFeatures.hasGeometry(row))
+		mExtentIndex.setBox(id, mFeatures.boundingBox(row));
 	else
-	{
-		mWkbType = QgsWkbTypes::Unknown;
-		mGeometryType = QgsWkbTypes::UnknownGeometry;
-	}
-	QString extra = stream.readLine();
-	while (!extra.contains("FeatureCodeEnd"))
-	{
-		//略过用户项
-		mCustomItems.append(extra);
-		extra = stream.readLine();
-	}
+		mExtentIndex.removeBox(id);
 }
 
-void QgsVctProvider::readTableStructure(QTextStream &stream)
+bool QgsVctProvider::isValid() const
 {
-	QStringList list = stream.readLine().split(',');
-	for (int i = 0; i < list[1].toInt(); i++)
-	{
-		QStringList extra = stream.readLine().split(',');
-		QString field = extra[0];
-		QString type = extra[1];
-		int length=0, prec=0;
-		if (type.contains("Int"))	type = "Int";
-		if (extra.length() >= 3)
-			length = extra[2].toInt();
-		if (extra.length() == 4)
-			prec = extra[3].toInt();
-		if (type == "Double")
-			mFields.append(QgsField(field, QVariant::Double, type, length, prec));
-		else if (type == "Int")
-			mFields.append(QgsField(field, QVariant::Int, type, length, prec));
-		else
-			mFields.append(QgsField(field, QVariant::String, type, length, prec));
-	}
+	//return mLayerValid;
+	return (mWkbType != QgsWkbTypes::Unknown);
 }
 
-void QgsVctProvider::readPoint(QTextStream &stream)
+QgsCoordinateReferenceSystem QgsVctProvider::crs() const
 {
-	QString extra = stream.readLine();
-	while (!extra.contains("PointEnd"))
-	{
-		int id = extra.toInt();
-		QString featureTypeCode = stream.readLine();
-		QString graphicCode = stream.readLine();
-		int featureType = stream.readLine().toInt();
-		QgsFeature f;
-		if (featureType != 4)
-		{
-			//独立点、结点、有向点
-			QStringList coordinates = stream.readLine().split(',');
-			double x = coordinates[0].toDouble();
-			double y = coordinates[1].toDouble();
-			QgsMultiPointXY pt;
-			pt.append(QgsPointXY(x, y));
-			f.setGeometry(QgsGeometry::fromMultiPointXY(pt));
-		}
-		else {
-			//点簇
-			int count = stream.readLine().toInt();
-			QgsMultiPointXY g;
-			for (int i = 0; i < count; i++)
-			{
-				QStringList coordinates = stream.readLine().split(',');
-				double x = coordinates[0].toDouble();
-				double y = coordinates[1].toDouble();
-				g.append(QgsPointXY(x, y));
-			}
-			f.setGeometry(QgsGeometry::fromMultiPointXY(g));
-		}
-		f.setId(id);
-		mFeatures.insert(id, f);
-		if (stream.readLine()=='0')
-		{
-			stream.readLine();
-			extra = stream.readLine();
-		}
-	}
+	return mCrs;
 }
 
-void QgsVctProvider::readLine(QTextStream &stream)
+bool QgsVctProvider::setSubsetString(const QString &subset, bool updateFeatureCount)
 {
-	QString extra = stream.readLine();
-	while (!extra.contains("LineEnd"))
-	{
-		int id = extra.toInt();
-		QString featureCode = stream.readLine();
-		QString graphicCode = stream.readLine();
-		int featureType = stream.readLine().toInt();
-		QgsFeature f;
-		QgsMultiPolylineXY g;
-		if (featureType == 1)
-		{
-			//直接坐标线
-			int count = stream.readLine().toInt();
-			for (int i = 0; i < count; i++)
-			{
-				int lineType = stream.readLine().toInt();
-				if (lineType == 11)
-				{
-					//折线
-					int ptCount = stream.readLine().toInt();
-					QgsPolylineXY pts;
-					for (int j = 0; j < ptCount; j++)
-					{
-						QStringList coordinates = stream.readLine().split(',');
-						double x = coordinates[0].toDouble();
-						double y = coordinates[1].toDouble();
-						pts.append(QgsPointXY(x, y));
-					}
-					g.append(QgsPolylineXY(pts));
-				}
-			}
-		}
-		f.setGeometry(QgsGeometry::fromMultiPolylineXY(g));
-		f.setId(id);
-		mFeatures.insert(id,f);
-		if (stream.readLine()=='0')
-		{
-			stream.readLine();
-			extra = stream.readLine();
-		}
-	}
-}
+	Q_UNUSED(updateFeatureCount)
 
-void QgsVctProvider::readPolygon(QTextStream &stream)
-{
-	QString extra = stream.readLine();
-	while (extra != "PolygonEnd")
+	if (subset == mSubsetString)
+		return true;
+
+	std::unique_ptr< QgsExpression > expression;
+	if (!subset.isEmpty())
 	{
-		int id = extra.toInt();
-		QString featureCode = stream.readLine();
-		QString graphicCode = stream.readLine();
-		int featureType = stream.readLine().toInt();
-		QStringList coordinate = stream.readLine().split(',');
-		QgsPointXY markPoint(coordinate[0].toDouble(), coordinate[1].toDouble());
-		QgsFeature f;
-		QgsMultiPolygonXY g;
-		QgsPolygonXY *polygon = nullptr;
-		int endFlag = -1;
-		int originalShape = -1;//保存上一个主面的geometryShape
-		if (featureType == 1)
-		{
-			//由直接坐标表示的面对象
-			int borderCount = stream.readLine().toInt();
-			int i = 0;
-			//for (int i = 0; i < borderCount; i++)
-			while (i < borderCount+1)//假设存在一个附属面
-			{
-				int geometryShape = stream.readLine().toInt();
-				if (geometryShape == 0)
-				{
-					//全部读取完毕
-					endFlag = 0;
-					if (polygon != nullptr)//保存最后一个主面
-						g.append(*polygon);
-					break;
-				}
-				//int pos = stream.pos();//记录位置
-				QString str = stream.readLine();
-				int pointCount;
-				if (!str.contains(','))
-				{
-					//主面
-					originalShape = geometryShape;
-					if (polygon != nullptr)//保存上一个主面
-						g.append(*polygon);
-					polygon = new QgsPolygonXY;
-					pointCount = str.toInt();
-					if (geometryShape == 11)
-					{
-						QgsPolylineXY polyline;
-						for (int j = 0; j < pointCount; j++)
-						{
-							QStringList coordinates = stream.readLine().split(',');
-							double x = coordinates[0].toDouble();
-							double y = coordinates[1].toDouble();
-							polyline.append(QgsPointXY(x, y));
-						}
-						polygon->append(polyline);
-					}
-				}
-				else {
-					//附属面
-					pointCount = geometryShape;
-					//stream.seek(pos);
-					if (originalShape == 11)
-					{
-						borderCount++;//假设存在下一个附属面
-						QgsPolylineXY polyline;
-						QStringList coordinates = str.split(',');
-						double x = coordinates[0].toDouble();
-						double y = coordinates[1].toDouble();
-						polyline.append(QgsPointXY(x, y));
-						for (int j = 0; j < pointCount - 1; j++)
-						{
-							QStringList coordinates = stream.readLine().split(',');
-							double x = coordinates[0].toDouble();
-							double y = coordinates[1].toDouble();
-							polyline.append(QgsPointXY(x, y));
-						}
-						polygon->append(polyline);
-					}
-				}
-				i++;
-			}
-		}
-		f.setGeometry(QgsGeometry::fromMultiPolygonXY(g));
-		f.setId(id);
-		mFeatures.insert(id, f);
-		if (endFlag == 0)
+		expression = qgis::make_unique< QgsExpression >(subset);
+		if (expression->hasParserError())
 		{
-			stream.readLine();
-			extra = stream.readLine();
+			pushError(tr("Invalid subset string %1: %2").arg(subset, expression->parserErrorString()));
+			return false;
 		}
-		//else if (stream.readLine() == '0')
-		//{
-		//	stream.readLine();
-		//	extra = stream.readLine();
-		//}
 	}
-}
 
-void QgsVctProvider::readSolid(QTextStream &stream)
-{
-	QString extra = stream.readLine();
-	while (!extra.contains("SolidEnd"))
-	{
-		extra = stream.readLine();
-	}
+	mSubsetString = subset;
+	mSubsetExpression = std::move(expression);
+	rebuildSubsetIndex();
+	clearMinMaxCache();
+
+	emit dataChanged();
+	return true;
 }
 
-void QgsVctProvider::readAggregation(QTextStream &stream)
+void QgsVctProvider::rebuildSubsetIndex()
 {
-	QString extra = stream.readLine();
-	while (!extra.contains("AggregationEnd"))
+	mStatistics.clear();
+	mExtentIndex.clear();
+	mSubsetIndex.clear();
+	mSubsetAttributes.clear();
+	mUseSubsetIndex = mSubsetExpression != nullptr;
+	if (!mUseSubsetIndex)
+		return;
+
+	mSubsetContext = QgsExpressionContext();
+	mSubsetContext << QgsExpressionContextUtils::globalScope()
+		<< QgsExpressionContextUtils::projectScope(QgsProject::instance());
+	mSubsetContext.setFields(mFields);
+	mSubsetExpression->prepare(&mSubsetContext);
+	mSubsetAttributes = mSubsetExpression->referencedAttributeIndexes(mFields);
+
+	//"field" = 'value' on a dictionary encoded column compares codes
+	QVector<int> rows;
+	if (equalityRows(rows))
 	{
-		extra = stream.readLine();
+		for (int row : qAsConst(rows))
+			mSubsetIndex.append(mFeatures.id(row));
+		return;
 	}
-}
 
-void QgsVctProvider::readAnnotation(QTextStream &stream)
-{
-	QString extra = stream.readLine();
-	while (!extra.contains("AnnotationEnd"))
+	//the expression is evaluated once per feature, iterators only look up the result
+	for (int row = 0; row < mFeatures.count(); row++)
 	{
-		extra = stream.readLine();
+		if (subsetAccepts(row))
+			mSubsetIndex.append(mFeatures.id(row));
 	}
 }
 
-void QgsVctProvider::readTopology(QTextStream &stream)
+bool QgsVctProvider::equalityRows(QVector<int> &rows) const
 {
-	QString extra = stream.readLine();
-	while (!extra.contains("TopologyEnd"))
-	{
-		extra = stream.readLine();
-	}
+	const QgsExpressionNode *root = mSubsetExpression->rootNode();
+	if (!root || root->nodeType() != QgsExpressionNode::ntBinaryOperator)
+		return false;
+	const QgsExpressionNodeBinaryOperator *equality = static_cast<const QgsExpressionNodeBinaryOperator *>(root);
+	if (equality->op() != QgsExpressionNodeBinaryOperator::boEQ)
+		return false;
+
+	const QgsExpressionNode *column = equality->opLeft();
+	const QgsExpressionNode *literal = equality->opRight();
+	if (column->nodeType() != QgsExpressionNode::ntColumnRef)
+		std::swap(column, literal);
+	if (column->nodeType() != QgsExpressionNode::ntColumnRef || literal->nodeType() != QgsExpressionNode::ntLiteral)
+		return false;
+
+	//other literal types follow the conversion rules of the expression engine
+	const QVariant value = static_cast<const QgsExpressionNodeLiteral *>(literal)->value();
+	if (value.type() != QVariant::String)
+		return false;
+	const int field = mFields.lookupField(static_cast<const QgsExpressionNodeColumnRef *>(column)->name());
+	return mFeatures.rowsEqualTo(field, value.toString(), rows);
 }
 
-void QgsVctProvider::readAttribute(QTextStream &stream)
+bool QgsVctProvider::subsetAccepts(int row)
 {
-	QString extra = stream.readLine();
-	while (!extra.contains("AttributeEnd"))
-	{
-		QString tableName = extra;
-		extra = stream.readLine();
-		while (!extra.contains("TableEnd"))
-		{
-			QStringList info = extra.split(',');
-			int id = info[0].toInt();
-			QgsFeature* f = &mFeatures[id];//深拷贝
-			QVector<QVariant> attrs;
-			for (int i = 1; i < info.size(); i++)
-			{
-				attrs.append(info[i]);
-			}
-			f->setAttributes(attrs);
-			extra = stream.readLine();
-		}
-		extra = stream.readLine();
-	}
+	QgsFeature feature(mFields, mFeatures.id(row));
+	if (mSubsetExpression->needsGeometry() && mFeatures.hasGeometry(row))
+		feature.setGeometry(mFeatures.geometry(row));
+	for (int field : qgis::as_const(mSubsetAttributes))
+		feature.setAttribute(field, mFeatures.attribute(row, field));
+
+	mSubsetContext.setFeature(feature);
+	return mSubsetExpression->evaluate(&mSubsetContext).toBool();
 }
 
-void QgsVctProvider::readStyle(QTextStream &stream)
+bool QgsVctProvider::updateSubsetIndex(int row)
 {
-	QString extra = stream.readLine();
-	while (!extra.contains("StyleEnd"))
-	{
-		extra = stream.readLine();
-	}
+	if (!mUseSubsetIndex)
+		return false;
+
+	const QgsFeatureId id = mFeatures.id(row);
+	QVector<QgsFeatureId>::iterator it = std::lower_bound(mSubsetIndex.begin(), mSubsetIndex.end(), id);
+	const bool indexed = it != mSubsetIndex.end() && *it == id;
+	const bool accepted = subsetAccepts(row);
+	if (accepted && !indexed)
+		mSubsetIndex.insert(it, id);
+	else if (!accepted && indexed)
+		mSubsetIndex.erase(it);
+	return accepted != indexed;
 }
 
 bool QgsVctProvider::addFeatures(QgsFeatureList &flist, Flags)
 {
+	//edits apply to the features of the file, not to the empty layer of a running load
+	if (!claimLayer())
+		return false;
 	bool result = true;
-	bool updateExtent = mFeatures.isEmpty() || !mExtent.isEmpty();
 	int fieldCount = mFields.count();
+	QgsFeatureList added;
 	
 	for (QgsFeatureList::iterator it = flist.begin(); it != flist.end(); it++)
 	{
@@ -578,40 +612,60 @@ bool QgsVctProvider::addFeatures(QgsFeatureList &flist, Flags)
 			continue;
 		}
 
-		mFeatures.insert(mNextFeatureId, *it);
+		insertFeature(*it);
+		added.append(*it);
 		mNextFeatureId++;
-
-		if (it->hasGeometry())
-		{
-			if (updateExtent)
-				mExtent.combineExtentWith(it->geometry().boundingBox());
-		}
 	}
 	clearMinMaxCache();
-	writeData();
+	if (!added.isEmpty())
+		saveEdit(QgsVctJournal::AddFeatures, QgsVctJournal::encode(added));
 	return result;
 }
 
+void QgsVctProvider::insertFeature(const QgsFeature &feature)
+{
+	int row = mFeatures.addFeature(feature.id());
+	if (feature.hasGeometry())
+		mFeatures.setGeometry(row, feature.geometry());
+	mFeatures.setAttributes(row, feature.attributes());
+	addToSpatialIndex(row);
+	updateSubsetIndex(row);
+	updateExtentIndex(row);
+	if (!mUseSubsetIndex || std::binary_search(mSubsetIndex.constBegin(), mSubsetIndex.constEnd(), feature.id()))
+		mStatistics.addRow(mFeatures, row);
+}
+
 bool QgsVctProvider::deleteFeatures(const QgsFeatureIds &id)
 {
-	for (QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); it++)
+	if (!claimLayer())
+		return false;
+	for (QgsFeatureIds::const_iterator it = id.constBegin(); it != id.constEnd(); ++it)
 	{
-		QgsFeatureMap::iterator fit = mFeatures.find(*it);
-
-		if (fit == mFeatures.end())	continue;
-
-		mFeatures.erase(fit);
+		int row = mFeatures.row(*it);
+		if (row < 0)
+			continue;
+		removeFromSpatialIndex(row);
+		mExtentIndex.removeBox(*it);
+		if (!mUseSubsetIndex || std::binary_search(mSubsetIndex.constBegin(), mSubsetIndex.constEnd(), *it))
+			mStatistics.removeRow(mFeatures, row);
+	}
+	mFeatures.removeFeatures(id);
+	if (mUseSubsetIndex)
+	{
+		mSubsetIndex.erase(std::remove_if(mSubsetIndex.begin(), mSubsetIndex.end(),
+			[&id](QgsFeatureId subsetId) { return id.contains(subsetId); }), mSubsetIndex.end());
 	}
 
-	updateExtents();
 	clearMinMaxCache();
-	writeData();
+	saveEdit(QgsVctJournal::DeleteFeatures, QgsVctJournal::encode(id));
 
 	return true;
 }
 
 bool QgsVctProvider::addAttributes(const QList<QgsField> &attributes)
 {
+	if (!claimLayer())
+		return false;
 	for (QList<QgsField>::const_iterator it = attributes.begin(); it != attributes.end(); it++)
 	{
 		switch (it->type())
@@ -633,20 +687,21 @@ bool QgsVctProvider::addAttributes(const QList<QgsField> &attributes)
 			continue;
 		}
 		mFields.append(*it);
-		for (QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); fit++)
-		{
-			QgsFeature &f = fit.value();
-			QgsAttributes attr = f.attributes();
-			attr.append(QVariant());
-			f.setAttributes(attr);
-		}
+		mFeatures.addField(it->type());
+	}
+	if (mUseSubsetIndex)
+	{
+		//the subset string is compiled against the fields
+		rebuildSubsetIndex();
 	}
-	writeData();
+	saveEdit(QgsVctJournal::AddAttributes, QgsVctJournal::encode(attributes));
 	return true;
 }
 
 bool QgsVctProvider::renameAttributes(const QgsFieldNameMap &renamedAttributes)
 {
+	if (!claimLayer())
+		return false;
 	bool result = true;
 	for (QgsFieldNameMap::const_iterator renameIt = renamedAttributes.constBegin(); renameIt != renamedAttributes.constEnd(); renameIt++)
 	{
@@ -665,12 +720,19 @@ bool QgsVctProvider::renameAttributes(const QgsFieldNameMap &renamedAttributes)
 
 		mFields.rename(fieldIndex, renameIt.value());
 	}
-	writeData();
+	if (mUseSubsetIndex)
+	{
+		//the subset string is compiled against the fields
+		rebuildSubsetIndex();
+	}
+	saveEdit(QgsVctJournal::RenameAttributes, QgsVctJournal::encode(renamedAttributes));
 	return result;
 }
 
 bool QgsVctProvider::deleteAttributes(const QgsAttributeIds &attributes)
 {
+	if (!claimLayer())
+		return false;
 	QList<int>attrIdx = attributes.toList();
 	std::sort(attrIdx.begin(), attrIdx.end(), std::greater<int>());
 
@@ -678,243 +740,370 @@ bool QgsVctProvider::deleteAttributes(const QgsAttributeIds &attributes)
 	{
 		int idx = *it;
 		mFields.remove(idx);
-
-		for (QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); fit++)
-		{
-			QgsFeature &f = fit.value();
-			QgsAttributes attr = f.attributes();
-			attr.remove(idx);
-			f.setAttributes(attr);
-		}
+		mFeatures.removeField(idx);
+	}
+	mStatistics.clear();
+	if (mUseSubsetIndex)
+	{
+		//the subset string is compiled against the fields
+		rebuildSubsetIndex();
 	}
 	clearMinMaxCache();
-	writeData();
+	saveEdit(QgsVctJournal::DeleteAttributes, QgsVctJournal::encode(attributes));
 	return true;
 }
 
 bool QgsVctProvider::changeAttributeValues(const QgsChangedAttributesMap &attr_map)
 {
+	if (!claimLayer())
+		return false;
+	bool subsetChanged = false;
 	for (QgsChangedAttributesMap::const_iterator it = attr_map.begin(); it != attr_map.end(); it++)
 	{
-		QgsFeatureMap::iterator fit = mFeatures.find(it.key());
-		if (fit == mFeatures.end())
+		int row = mFeatures.row(it.key());
+		if (row < 0)
 			continue;
 
+		bool subsetAttributeChanged = false;
+		//features outside the subset are not counted by the statistics
+		const bool counted = !mUseSubsetIndex || std::binary_search(mSubsetIndex.constBegin(), mSubsetIndex.constEnd(), it.key());
 		const QgsAttributeMap &attrs = it.value();
 		for (QgsAttributeMap::const_iterator it2 = attrs.constBegin(); it2 != attrs.constEnd(); ++it2)
-			fit->setAttribute(it2.key(), it2.value());
+		{
+			if (counted)
+				mStatistics.removeValue(it2.key(), mFeatures.attribute(row, it2.key()));
+			mFeatures.setAttribute(row, it2.key(), it2.value());
+			if (counted)
+				mStatistics.addValue(it2.key(), mFeatures.attribute(row, it2.key()));
+			if (mFeatures.hasConversionError(row, it2.key()))
+				pushError(tr("Value %1 of feature %2 does not match the type of field %3").arg(it2.value().toString()).arg(it.key()).arg(mFields.at(it2.key()).name()));
+			subsetAttributeChanged |= mSubsetAttributes.contains(it2.key());
+		}
+		if (subsetAttributeChanged)
+		{
+			updateSubsetIndex(row);
+			updateExtentIndex(row);
+			subsetChanged = true;
+		}
+	}
+	if (subsetChanged)
+	{
+		//features entered or left the subset
+		mStatistics.clear();
 	}
 	clearMinMaxCache();
-	writeData();
+	saveEdit(QgsVctJournal::ChangeAttributeValues, QgsVctJournal::encode(attr_map));
 	return true;
 }
 
 bool QgsVctProvider::changeGeometryValues(const QgsGeometryMap &geometry_map)
 {
+	if (!claimLayer())
+		return false;
+	bool subsetChanged = false;
 	for (QgsGeometryMap::const_iterator it = geometry_map.begin(); it != geometry_map.end(); it++)
 	{
-		QgsFeatureMap::iterator fit = mFeatures.find(it.key());
-		if (fit == mFeatures.end())
+		int row = mFeatures.row(it.key());
+		if (row < 0)
 			continue;
 
-		fit->setGeometry(it.value());
+		removeFromSpatialIndex(row);
+		mFeatures.setGeometry(row, it.value());
+		addToSpatialIndex(row);
+		if (mUseSubsetIndex && mSubsetExpression->needsGeometry())
+			subsetChanged |= updateSubsetIndex(row);
+		updateExtentIndex(row);
+	}
+	if (subsetChanged)
+	{
+		//features entered or left the subset
+		mStatistics.clear();
+		clearMinMaxCache();
 	}
 
-	updateExtents();
-	writeData();
+	saveEdit(QgsVctJournal::ChangeGeometryValues, QgsVctJournal::encode(geometry_map));
 	return true;
 }
 
-void QgsVctProvider::writeData()
+void QgsVctProvider::saveEdit(QgsVctJournal::Operation operation, const QByteArray &payload)
 {
-	QFile vctFile(mUri);
-	vctFile.open(QIODevice::WriteOnly);
-	QTextStream vctStream(&vctFile);
-	vctStream.setCodec(QTextCodec::codecForName("UTF-8"));
+	mStoreUsageValid = false;
+	if (mReplayingJournal)
+		return;
 
-	vctStream << "HeadBegin\n";
-	for (int i = 0;i < mHead.size(); i++)
+	if (mBackgroundSaving)
 	{
-		vctStream << mHead[i] <<"\n";
+		//restarting the timer merges a burst of edits into one save, in update mode it starts when the mode is left
+		mEditsPending = true;
+		if (mUpdateModeDepth == 0)
+			mSaveTimer.start();
+		return;
 	}
-	vctStream << "HeadEnd\n";
 
-	vctStream << "FeatureCodeBegin\n";
-	if (mGeometryType == QgsWkbTypes::PointGeometry)
-		vctStream << mFeatureTypeCode << "," << mFeatureTypeName << "," << "Point," << mAttributeTableName << "\n";
-	else if (mGeometryType == QgsWkbTypes::LineGeometry)
-		vctStream << mFeatureTypeCode << "," << mFeatureTypeName << "," << "Line," << mAttributeTableName << "\n";
-	else if (mGeometryType == QgsWkbTypes::PolygonGeometry)
-		vctStream << mFeatureTypeCode << "," << mFeatureTypeName << "," << "Polygon," << mAttributeTableName << "\n";
-	if (mCustomItems.size() > 0)
+	//the journal misses the edits after one it could not take, they are all in the next write of the file
+	if (!mEditsPending && mJournalEnabled && mJournal.append(operation, payload))
 	{
-		for (int i = 0; i < mCustomItems.size(); i++)
-		{
-			vctStream << mCustomItems[i] << "\n";
-		}
+		mJournalStale = false;
+		if (mJournal.size() > JOURNAL_COMPACTION_SIZE)
+			compactJournal();
+		return;
 	}
-	vctStream << "FeatureCodeEnd\n";
 
-	vctStream << "TableStructureBegin\n";
-	vctStream << mAttributeTableName << "," << mFields.size() << "\n";
-	for (int i = 0; i < mFields.size(); i++)
+	//without the journal only the file keeps the edit, in update mode it is written once when the mode is left
+	mEditsPending = true;
+	if (mUpdateModeDepth == 0)
+		compactJournal();
+}
+
+bool QgsVctProvider::compactJournal()
+{
+	if (!claimLayer())
+		return false;
+	mSaveTimer.stop();
+	mSaveWatcher.waitForFinished();
+	//the journal is the only durable copy of the edits until the file has them
+	if (!writeData())
+		return false;
+	mEditsPending = false;
+	mJournalStale = false;
+	updateMemoryUsage();
+	return mJournal.clear();
+}
+
+bool QgsVctProvider::enterUpdateMode()
+{
+	++mUpdateModeDepth;
+	return true;
+}
+
+bool QgsVctProvider::leaveUpdateMode()
+{
+	if (mUpdateModeDepth == 0)
+		return false;
+
+	if (--mUpdateModeDepth == 0 && mEditsPending)
 	{
-		vctStream << mFields[i].name() << "," << mFields[i].typeName();
-		if (mFields[i].typeName() == "Double")
-			vctStream << mFields[i].length() << "," << mFields[i].precision() << "\n";
-		else
-			vctStream << "\n";
+		if (!mBackgroundSaving)
+			return compactJournal();
+		startBackgroundSave();
 	}
-	vctStream << "0\nTableStructureEnd\n";
+	return true;
+}
 
-	vctStream << "PointBegin\n";
-	if (mGeometryType == QgsWkbTypes::PointGeometry)
+void QgsVctProvider::startBackgroundSave()
+{
+	//the next save starts when the running one has finished
+	if (!mEditsPending || mSaveWatcher.isRunning())
+		return;
+
+	const std::shared_ptr<QgsVctDataset> dataset = mDataset;
+	const int layer = mLayerIndex;
+	const QgsFields fields = mFields;
+	const QgsVctFeatureStore features = mFeatures;
+	mEditsPending = false;
+	mSaveWatcher.setFuture(QtConcurrent::run([dataset, layer, fields, features]()
 	{
-		for (QgsFeatureMap::const_iterator it = mFeatures.begin(); it != mFeatures.end(); it++)
-		{
-			vctStream << it.key() << "\n";
-			vctStream << mFeatureTypeCode << "\n";
-			vctStream << mFeatureTypeCode << "\n";//图形表现编码
-			QgsMultiPointXY g = it.value().geometry().asMultiPoint();
-			if (g.size() > 1)
-			{
-				vctStream << 4 << "\n";
-			}
-			else
-			{
-				vctStream << 1 << "\n";
-			}
-			for (int i = 0; i < g.size(); i++)
-			{
-				vctStream << g[i].toString() << "\n";
-			}
-			vctStream << 0 << "\n\n";
-		}
+		QString error;
+		dataset->write(layer, fields, features, error);
+		return error;
+	}));
+}
+
+void QgsVctProvider::backgroundSaveFinished()
+{
+	const QString error = mSaveWatcher.result();
+	if (!error.isEmpty())
+	{
+		//retried with the next edit, or written synchronously when the provider is deleted
+		pushError(tr("Could not write VCT file %1: %2").arg(mPath, error));
+		mEditsPending = true;
+		return;
 	}
-	vctStream << "PointEnd\n";
 
-	vctStream << "LineBegin\n";
-	if (mGeometryType == QgsWkbTypes::LineGeometry)
+	//the file contains the edits replayed from the journal
+	if (!mJournal.isEmpty())
+		mJournal.clear();
+	mJournalStale = false;
+	//without edits made while saving, the lazy records are read from the written file
+	if (!mEditsPending)
+		mFeatures = mDataset->layer(mLayerIndex).features;
+	mStoreUsageValid = false;
+	updateMemoryUsage();
+	emit editsSaved();
+
+	//edits made while saving
+	if (mEditsPending && mUpdateModeDepth == 0 && !mSaveTimer.isActive())
+		mSaveTimer.start();
+}
+
+void QgsVctProvider::replayJournal()
+{
+	QList<QgsVctJournal::Entry> entries;
+	QString error;
+	if (!mJournal.read(entries, error))
 	{
-		for (QgsFeatureMap::const_iterator it = mFeatures.begin(); it != mFeatures.end(); it++)
-		{
-			vctStream << it.key() << "\n";
-			vctStream << mFeatureTypeCode << "\n";
-			vctStream << mFeatureTypeCode << "\n";//图形表现编码
-			QgsMultiPolylineXY g = it.value().geometry().asMultiPolyline();
-			if(g.size()>0)
-			{
-				vctStream << 1 << "\n" << g.size() << "\n";//直接坐标线
-				for (int i = 0; i < g.size(); i++)
-				{
-					vctStream << 11 << "\n";//折线
-					vctStream << g[i].size() << "\n";
-					for (int j = 0; j < g[i].size(); j++)
-					{
-						vctStream << g[i][j].toString() << "\n";
-					}
-				}
-			}
-			else
-			{
-				QgsPolylineXY g = it.value().geometry().asPolyline();
-				vctStream << 1 << "\n" << 1 << "\n";//直接坐标线
-				vctStream << 11 << "\n";//折线
-				vctStream << g.size() << "\n";
-				for (int i = 0; i < g.size(); i++)
-				{
-					vctStream << g[i].toString() << "\n";
-				}
-			}
-			vctStream << 0 << "\n\n";
-		}
+		mJournalStale = true;
+		pushError(error);
+		QgsMessageLog::logMessage(error, tr("VCT"), Qgis::Warning);
+		return;
 	}
-	vctStream << "LineEnd\n";
+	if (entries.isEmpty())
+		return;
 
-	vctStream << "PolygonBegin\n";
-	if (mGeometryType == QgsWkbTypes::PolygonGeometry)
+	//the public edit functions apply the entries, saveEdit() does not record them again
+	mReplayingJournal = true;
+	for (const QgsVctJournal::Entry &entry : qAsConst(entries))
 	{
-		for (QgsFeatureMap::const_iterator it = mFeatures.begin(); it != mFeatures.end(); it++)
+		bool ok = false;
+		switch (entry.operation)
 		{
-			vctStream << it.key() << "\n";
-			vctStream << mFeatureTypeCode << "\n";
-			vctStream << mFeatureTypeCode << "\n";//图形表现编码
-			QgsMultiPolygonXY g = it.value().geometry().asMultiPolygon();
-			vctStream << 1 << "\n" << "0.0,0.0\n";//由直接坐标表示的面对象
-			if (g.size() > 0)
-			{
-				vctStream << g.size() << "\n";//圈数
-				for (int i = 0; i < g.size(); i++)
-				{
-					vctStream << 11 << "\n";//多边形
-					for (int j = 0; j < g[i].size(); j++)
-					{
-						vctStream << g[i][j].size() << "\n";//点数
-						for (int k = 0; k < g[i][j].size(); k++)
-						{
-							vctStream << g[i][j][k].toString() << "\n";
-						}
-					}
-				}
-			}
-			else
+		case QgsVctJournal::AddFeatures:
+		{
+			QgsFeatureList features;
+			ok = QgsVctJournal::decode(entry.payload, features);
+			for (const QgsFeature &feature : qAsConst(features))
 			{
-				QgsPolygonXY g = it.value().geometry().asPolygon();
-				vctStream << 1 << "\n";//圈数
-				vctStream << 11 << "\n";//多边形
-				for (int i = 0; i < g.size(); i++)
-				{
-					vctStream << g[i].size() << "\n";//点数
-					for (int j = 0; j < g[i].size(); j++)
-					{
-						vctStream << g[i][j].toString() << "\n";
-					}
-				}
+				insertFeature(feature);
+				mNextFeatureId = std::max(mNextFeatureId, feature.id() + 1);
 			}
-			vctStream << 0 << "\n\n";
+			break;
+		}
+		case QgsVctJournal::DeleteFeatures:
+		{
+			QgsFeatureIds ids;
+			ok = QgsVctJournal::decode(entry.payload, ids) && deleteFeatures(ids);
+			break;
+		}
+		case QgsVctJournal::ChangeAttributeValues:
+		{
+			QgsChangedAttributesMap attributes;
+			ok = QgsVctJournal::decode(entry.payload, attributes) && changeAttributeValues(attributes);
+			break;
+		}
+		case QgsVctJournal::ChangeGeometryValues:
+		{
+			QgsGeometryMap geometries;
+			ok = QgsVctJournal::decode(entry.payload, geometries) && changeGeometryValues(geometries);
+			break;
+		}
+		case QgsVctJournal::AddAttributes:
+		{
+			QList<QgsField> fields;
+			ok = QgsVctJournal::decode(entry.payload, fields) && addAttributes(fields);
+			break;
 		}
+		case QgsVctJournal::RenameAttributes:
+		{
+			QgsFieldNameMap names;
+			ok = QgsVctJournal::decode(entry.payload, names);
+			renameAttributes(names);
+			break;
+		}
+		case QgsVctJournal::DeleteAttributes:
+		{
+			QgsAttributeIds fields;
+			ok = QgsVctJournal::decode(entry.payload, fields) && deleteAttributes(fields);
+			break;
+		}
+		}
+		if (!ok)
+			QgsDebugMsg(QStringLiteral("Could not replay entry of type %1 of %2").arg(entry.operation).arg(mJournal.path()));
 	}
-	vctStream << "PolygonEnd\n";
-
-	vctStream << "AnnotationBegin\n";
-	vctStream << "AnnotationEnd\n";
+	mReplayingJournal = false;
+}
 
-	vctStream << "AttributeBegin\n";
-	vctStream << mAttributeTableName << "\n";
-	for (QgsFeatureMap::const_iterator it = mFeatures.begin(); it != mFeatures.end(); it++)
+bool QgsVctProvider::writeData()
+{
+	QString error;
+	if (!mDataset->write(mLayerIndex, mFields, mFeatures, error))
 	{
-		QgsFeature f = it.value();
-		vctStream << f.id() << ",";
-		for (int i = 0; i < f.attributes().size(); i++)
-		{
-			vctStream << f.attributes()[i].toString();
-			if (i != f.attributes().size() - 1)
-				vctStream << ",";
-			else
-				vctStream << "\n";
-		}
+		pushError(tr("Could not write VCT file %1: %2").arg(mPath, error));
+		return false;
 	}
-	vctStream << "TableEnd\n";
-	vctStream << "AttributeEnd\n";
+	//the same features, with their lazy records moved into the written file
+	mFeatures = mDataset->layer(mLayerIndex).features;
+	mStoreUsageValid = false;
+	return true;
+}
+
+QVariant QgsVctProvider::minimumValue(int index) const
+{
+	if (index < 0 || index >= mFields.count())
+		return QVariant();
+	const QVariant minimum = mStatistics.minimum(index, mFeatures, mUseSubsetIndex ? &mSubsetIndex : nullptr);
+	updateMemoryUsage();
+	return minimum;
+}
 
-	vctFile.close();
+QVariant QgsVctProvider::maximumValue(int index) const
+{
+	if (index < 0 || index >= mFields.count())
+		return QVariant();
+	const QVariant maximum = mStatistics.maximum(index, mFeatures, mUseSubsetIndex ? &mSubsetIndex : nullptr);
+	updateMemoryUsage();
+	return maximum;
+}
+
+QSet<QVariant> QgsVctProvider::uniqueValues(int fieldIndex, int limit) const
+{
+	if (fieldIndex < 0 || fieldIndex >= mFields.count())
+		return QSet<QVariant>();
+	const QSet<QVariant> values = mStatistics.uniqueValues(fieldIndex, limit, mFeatures, mUseSubsetIndex ? &mSubsetIndex : nullptr);
+	updateMemoryUsage();
+	return values;
 }
 
 void QgsVctProvider::updateExtents()
 {
-	mExtent.setMinimal();
+	//rebuilt from the bounding boxes in the store on the next request
+	mExtentIndex.clear();
+}
+
+QStringList QgsVctProvider::subLayers() const
+{
+	//one entry per feature class, laid out like the sublayers of the OGR provider
+	QStringList sublayers;
+	for (int i = 0; i < mDataset->layerCount(); i++)
+	{
+		const QgsVctLayerContent layer = mDataset->layer(i);
+		sublayers << QStringList({ QString::number(i), mDataset->layerNames().at(i), QString::number(layer.features.count()),
+			QgsWkbTypes::displayString(layer.wkbType), QString() }).join(QgsDataProvider::sublayerSeparator());
+	}
+	return sublayers;
+}
+
+void QgsVctProvider::decodeUri(const QString &uri, QString &path, QString &layerName)
+{
+	const int separator = uri.indexOf(QLatin1String("|layername="));
+	path = separator < 0 ? uri : uri.left(separator);
+	layerName = separator < 0 ? QString() : uri.mid(separator + 11);
+	if (path.startsWith(QLatin1String("file:")))
+		path = QUrl(path).toLocalFile();
+}
+
+QString QgsVctProvider::encodeUri(const QString &path, const QString &layerName)
+{
+	if (layerName.isEmpty())
+		return path;
+	return QStringLiteral("%1|layername=%2").arg(path, layerName);
 }
 
 QVariantMap QgsVctProviderMetadata::decodeUri(const QString &uri )
 {
+	QString path;
+	QString layerName;
+	QgsVctProvider::decodeUri(uri, path, layerName);
 	QVariantMap components;
-	components.insert(QStringLiteral("path"), QUrl(uri).toLocalFile());
+	components.insert(QStringLiteral("path"), path);
+	if (!layerName.isEmpty())
+		components.insert(QStringLiteral("layerName"), layerName);
 	return components;
 }
 
 QString QgsVctProviderMetadata::encodeUri(const QVariantMap &parts)
 {
-	return QStringLiteral("file://%1").arg(parts.value(QStringLiteral("path")).toString());
+	return QgsVctProvider::encodeUri(QStringLiteral("file://%1").arg(parts.value(QStringLiteral("path")).toString()),
+		parts.value(QStringLiteral("layerName")).toString());
 }
 
 QgsDataProvider *QgsVctProviderMetadata::createProvider(const QString &uri, const QgsDataProvider::ProviderOptions &options)
@@ -922,6 +1111,12 @@ QgsDataProvider *QgsVctProviderMetadata::createProvider(const QString &uri, cons
 	return new QgsVctProvider(uri, options);
 }
 
+void QgsVctProviderMetadata::cleanupProvider()
+{
+	//retained datasets must not outlive the application
+	QgsVctDataset::releaseAll();
+}
+
 QgsVctProviderMetadata::QgsVctProviderMetadata():
 	QgsProviderMetadata(QgsVctProvider::VCT_PROVIDER_KEY, QgsVctProvider::VCT_PROVIDER_DESCRIPTION)
 {
@@ -6,10 +6,17 @@
 #include "qgsfields.h"
 #include "qgsspatialindex.h"
 #include "qgsprovidermetadata.h"
+#include "qgsexpression.h"
+#include "qgsexpressioncontext.h"
+#include "qgsvctdataset.h"
+#include "qgsvctfeaturestore.h"
+#include "qgsvctjournal.h"
+#include "qgsvctstatistics.h"
+#include "qgsvctextentindex.h"
 
 #include "QTextStream"
-
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
+#include <QFutureWatcher>
+#include <QTimer>
 
 class QgsFeature;
 class QgsField;
@@ -51,12 +58,13 @@ public:
 	bool isValid() const override;
 	QgsCoordinateReferenceSystem crs() const override;
 	bool setSubsetString(const QString &subset, bool updateFeatureCount = true) override;
-	bool supportsSubsetString() const override { return false; }
+	bool supportsSubsetString() const override { return true; }
 	QString subsetString() const override
 	{
 		return mSubsetString;
 	}
 	QString dataComment() const override;
+	QString htmlMetadata() const override;
 	bool addFeatures(QgsFeatureList &flist, QgsFeatureSink::Flags flags = nullptr) override;
 	bool deleteFeatures(const QgsFeatureIds &id) override;
 	bool addAttributes(const QList<QgsField> &attributes) override;
@@ -64,7 +72,76 @@ public:
 	bool deleteAttributes(const QgsAttributeIds &attributes) override;
 	bool changeAttributeValues(const QgsChangedAttributesMap &attr_map) override;
 	bool changeGeometryValues(const QgsGeometryMap &geometry_map) override;
+	QVariant minimumValue(int index) const override;
+	QVariant maximumValue(int index) const override;
+	QSet<QVariant> uniqueValues(int fieldIndex, int limit = -1) const override;
 	void updateExtents() override;
+	//! One sublayer per feature class of the file, named after its feature code
+	QStringList subLayers() const override;
+
+	//! Splits a data source "path|layername=CODE" into the file path and the feature code of the layer
+	static void decodeUri(const QString &uri, QString &path, QString &layerName);
+	static QString encodeUri(const QString &path, const QString &layerName);
+
+	/**
+	 * Defers writing the file: edits between enterUpdateMode() and the matching leaveUpdateMode() are
+	 * only appended to the journal, which is compacted at its size threshold or when the provider is
+	 * deleted. Edits the journal cannot take are written once when the outermost update mode is left.
+	 * Layers enter the update mode for the duration of an editing session, scripts can use it around bulk imports.
+	 */
+	bool enterUpdateMode() override;
+	bool leaveUpdateMode() override;
+
+	/**
+	 * Writes the edits recorded in the journal or deferred in update mode into the VCT file and removes the journal.
+	 * This happens automatically above a journal size threshold and when the provider is deleted.
+	 */
+	bool compactJournal();
+
+	//! Estimated bytes held in memory by a layer
+	struct MemoryUsage
+	{
+		qint64 coordinates = 0;
+		qint64 attributes = 0;
+		//! Row ids, spatial index and subset index
+		qint64 indexes = 0;
+		//! Decoded records, attribute statistics and extent index, which are rebuilt when needed
+		qint64 caches = 0;
+
+		qint64 total() const { return coordinates + attributes + indexes + caches; }
+	};
+
+	/**
+	 * Estimated resident footprint of the layer. Buffers that are implicitly shared with the parsed file
+	 * or other layers are counted by each of them.
+	 */
+	MemoryUsage memoryUsage() const;
+
+	/**
+	 * Drops the caches of the layer, they are rebuilt when needed. When the VCT layers of the process
+	 * exceed the memory budget the layers with the largest caches release them first.
+	 */
+	void releaseCaches() const;
+
+	/**
+	 * True while the records of the file are read on a worker thread, when providers/vct/backgroundLoading
+	 * is set. Meanwhile the layer has its fields but no features: featureCount() is -1, the extent is
+	 * empty and iterators return no features. When the load finishes, fullExtentCalculated() and
+	 * dataChanged() are emitted. Edits wait for the load.
+	 */
+	bool isLoading() const { return mLoading; }
+	//! Progress of the load in percent, canceling it leaves the layer empty and read-only. Shared by the layers of the file
+	QgsFeedback *loadingFeedback() const;
+	//! Blocks until the file is loaded, returns false when the load failed and the layer is read-only
+	bool waitForLoaded();
+
+signals:
+
+	/**
+	 * Emitted when a background save has written the edits to the VCT file.
+	 * Failures are reported through raiseError().
+	 */
+	void editsSaved();
 
 
 private:
@@ -72,60 +149,104 @@ private:
 	QString mSubsetString;
 
 	bool mLayerValid = false;
-	int mNextFeatureId = 0;
-	//Vct file writing functions
-	void writeData();
+	QgsFeatureId mNextFeatureId = 0;
+	//Vct file writing functions, false when the file could not be written
+	bool writeData();
+
+	//Background saving: edits are written on another thread shortly after the last one of a burst
+	bool mBackgroundSaving = false;
+	QTimer mSaveTimer;
+	QFutureWatcher<QString> mSaveWatcher;
+	void startBackgroundSave();
+	void backgroundSaveFinished();
 
-	//Vct file reading functions
+	//Edit journal
+	QgsVctJournal mJournal;
+	bool mJournalEnabled = true;
+	bool mJournalStale = false;
+	bool mReplayingJournal = false;
+	//Deferred saving in update mode
+	int mUpdateModeDepth = 0;
+	bool mEditsPending = false;
+	void saveEdit(QgsVctJournal::Operation operation, const QByteArray &payload);
+	//Loading in the background
+	bool mLoading = false;
+	//a failed or canceled load leaves the features incomplete, they are never written back
+	bool mLoadFailed = false;
+	//Journal ownership: of the providers of one layer only the editor appends to its journal and saves
+	bool mEditor = false;
+	//saves of the layer before its features were taken from the dataset
+	int mRevision = 0;
+	//! Waits for the load and makes this provider the editor of the layer, false when the layer is read-only
+	bool claimLayer();
+	QFutureWatcher<void> mLoadWatcher;
+	//Takes the features of the layer from the loaded dataset, \a notify tells the layer they changed
+	void finishLoading(bool notify);
+	void replayJournal();
+	void insertFeature(const QgsFeature &feature);
+
+	//Parsed file shared with the providers of its other feature classes
 	QString mUri;
-	void readData(QString uri);
-	void readComment(QTextStream &stream);
-	void readHead(QTextStream &stream);
-	void readFeatureCode(QTextStream &stream);
-	void readTableStructure(QTextStream &stream);
-	void readPoint(QTextStream &stream);
-	void readLine(QTextStream &stream);
-	void readPolygon(QTextStream &stream);
-	void readSolid(QTextStream &stream);
-	void readAggregation(QTextStream &stream);
-	void readAnnotation(QTextStream &stream);
-	void readTopology(QTextStream &stream);
-	void readAttribute(QTextStream &stream);
-	void readStyle(QTextStream &stream);
-
-	//ע
-	QStringList mComments;
+	QString mPath;
+	std::shared_ptr<QgsVctDataset> mDataset;
+	//! Profile of the iterators, shared with the feature sources
+	std::shared_ptr<QgsVctProfile> mProfile = std::make_shared<QgsVctProfile>();
+	int mLayerIndex = -1;
+
+	//Memory accounting, the estimate of the store is kept until the next edit
+	qint64 mMemoryBudget = 0;
+	mutable MemoryUsage mStoreUsage;
+	mutable bool mStoreUsageValid = false;
+	//Publishes the usage of the layer to the process wide accounting and enforces the budget
+	void updateMemoryUsage() const;
+
+	//Spatial index maintenance for the feature at row
+	void addToSpatialIndex(int row);
+	void removeFromSpatialIndex(int row);
+	//Extent index maintenance for the feature at row, after its geometry or subset membership changed
+	void updateExtentIndex(int row);
+
+	//Subset index maintenance
+	void rebuildSubsetIndex();
+	bool subsetAccepts(int row);
+	//Rows matched by a subset string of the form "field" = 'value', false if it is not one
+	bool equalityRows(QVector<int> &rows) const;
+	//! Adds \a row to the subset index or removes it, returns true when its membership changed
+	bool updateSubsetIndex(int row);
 
 	//ļͷ
 	QgsCoordinateReferenceSystem mCrs;
-	mutable QgsRectangle mExtent;
-	QVector<QString> mHead;
 
 	//ҪͲ
-	QString mFeatureTypeCode;//Ҫͱ
-	QString mFeatureTypeName;//Ҫ
-	QString mAttributeTableName;//Ա
 	QgsWkbTypes::Type mWkbType = QgsWkbTypes::NoGeometry;
 	QgsWkbTypes::GeometryType mGeometryType = QgsWkbTypes::UnknownGeometry;
-	QVector<QString> mCustomItems;//ûԶ
 
 
 	//ݽṹ
 	QgsFields mFields;
 
 	//Features
-	QgsFeatureMap mFeatures;
+	QgsVctFeatureStore mFeatures;
 
-	//std::unique_ptr< QgsExpression > mSubsetExpression;
+	//Subset string compiled against mFields
+	std::unique_ptr< QgsExpression > mSubsetExpression;
+	QgsExpressionContext mSubsetContext;
+	QgsAttributeIds mSubsetAttributes;
 
 	//Spatial index
 	QgsSpatialIndex *mSpatialIndex = nullptr;
 
 
 
-	/*mutable QList<quintptr> mSubsetIndex;
-	mutable bool mUseSubsetIndex = false;
-	mutable bool mCachedUseSubsetIndex;*/
+	//Sorted ids of the features matching the subset string
+	QVector<QgsFeatureId> mSubsetIndex;
+	bool mUseSubsetIndex = false;
+
+	//Attribute statistics of the features in the subset, computed on request
+	mutable QgsVctStatistics mStatistics;
+
+	//Bounding boxes of the features in the subset, built on the first extent request
+	mutable QgsVctExtentIndex mExtentIndex;
 
 	friend class QgsVctFeatureIterator;
 	friend class QgsVctFeatureSource;
@@ -138,4 +259,5 @@ public:
 	QgsDataProvider *createProvider(const QString &uri, const QgsDataProvider::ProviderOptions &options) override;
 	QVariantMap decodeUri(const QString &uri) override;
 	QString encodeUri(const QVariantMap &parts) override;
+	void cleanupProvider() override;
 };
@@ -0,0 +1,168 @@
+#include "qgsvctrecordcache.h"
+
+#include <QMutexLocker>
+
+namespace
+{
+	//bookkeeping of an entry in the hash and its segment
+	const qint64 ENTRY_OVERHEAD = 96;
+
+	qint64 attributesCost(const QgsAttributes &attributes)
+	{
+		qint64 cost = ENTRY_OVERHEAD + qint64(attributes.count()) * qint64(sizeof(QVariant));
+		for (const QVariant &value : attributes)
+		{
+			if (value.type() == QVariant::String)
+				cost += qint64(value.toString().size()) * qint64(sizeof(QChar));
+		}
+		return cost;
+	}
+}
+
+QgsVctRecordCache::QgsVctRecordCache(qint64 budget)
+	: mBudget(budget)
+{
+}
+
+qint64 QgsVctRecordCache::size() const
+{
+	QMutexLocker locker(&mMutex);
+	return mProbationCost + mProtectedCost;
+}
+
+void QgsVctRecordCache::clear()
+{
+	QMutexLocker locker(&mMutex);
+	mEntries.clear();
+	mProbation.clear();
+	mProtected.clear();
+	mProbationCost = 0;
+	mProtectedCost = 0;
+	mLastKey = Key(FID_NULL, -1);
+}
+
+bool QgsVctRecordCache::geometry(QgsFeatureId id, QgsGeometry &geometry)
+{
+	QMutexLocker locker(&mMutex);
+	const Entry *entry = use(Key(id, Geometry));
+	if (entry == nullptr)
+		return false;
+	geometry = entry->geometry;
+	return true;
+}
+
+void QgsVctRecordCache::insertGeometry(QgsFeatureId id, const QgsGeometry &geometry, int vertexCount)
+{
+	Entry entry;
+	entry.geometry = geometry;
+	entry.cost = ENTRY_OVERHEAD + qint64(vertexCount) * 2 * qint64(sizeof(double));
+	QMutexLocker locker(&mMutex);
+	insert(Key(id, Geometry), entry);
+}
+
+bool QgsVctRecordCache::attributes(QgsFeatureId id, QgsAttributes &attributes)
+{
+	QMutexLocker locker(&mMutex);
+	const Entry *entry = use(Key(id, Attributes));
+	if (entry == nullptr)
+		return false;
+	attributes = entry->attributes;
+	return true;
+}
+
+void QgsVctRecordCache::insertAttributes(QgsFeatureId id, const QgsAttributes &attributes)
+{
+	Entry entry;
+	entry.attributes = attributes;
+	entry.cost = attributesCost(attributes);
+	QMutexLocker locker(&mMutex);
+	insert(Key(id, Attributes), entry);
+}
+
+const QgsVctRecordCache::Entry *QgsVctRecordCache::use(const Key &key)
+{
+	const QHash<Key, Entry>::iterator it = mEntries.find(key);
+	if (it == mEntries.end())
+		return nullptr;
+
+	Entry &entry = *it;
+	const bool reused = key != mLastKey;
+	mLastKey = key;
+	if (entry.isProtected)
+	{
+		mProtected.splice(mProtected.begin(), mProtected, entry.position);
+	}
+	else if (reused)
+	{
+		mProbation.erase(entry.position);
+		mProbationCost -= entry.cost;
+		mProtected.push_front(key);
+		entry.position = mProtected.begin();
+		entry.isProtected = true;
+		mProtectedCost += entry.cost;
+		evict();
+	}
+	else
+	{
+		mProbation.splice(mProbation.begin(), mProbation, entry.position);
+	}
+	return &entry;
+}
+
+void QgsVctRecordCache::insert(const Key &key, Entry entry)
+{
+	//a record larger than the whole cache is not kept
+	if (entry.cost > mBudget)
+		return;
+	const QHash<Key, Entry>::iterator existing = mEntries.find(key);
+	if (existing != mEntries.end())
+		remove(existing);
+
+	mLastKey = key;
+	mProbation.push_front(key);
+	entry.position = mProbation.begin();
+	entry.isProtected = false;
+	mProbationCost += entry.cost;
+	mEntries.insert(key, entry);
+	evict();
+}
+
+void QgsVctRecordCache::remove(QHash<Key, Entry>::iterator it)
+{
+	if (it->isProtected)
+	{
+		mProtected.erase(it->position);
+		mProtectedCost -= it->cost;
+	}
+	else
+	{
+		mProbation.erase(it->position);
+		mProbationCost -= it->cost;
+	}
+	mEntries.erase(it);
+}
+
+void QgsVctRecordCache::evict()
+{
+	//protected records beyond their share get a last chance in probation
+	const qint64 protectedBudget = qint64(double(mBudget) * PROTECTED_SHARE);
+	while (mProtectedCost > protectedBudget && !mProtected.empty())
+	{
+		const Key key = mProtected.back();
+		Entry &entry = mEntries[key];
+		mProtected.pop_back();
+		mProtectedCost -= entry.cost;
+		mProbation.push_front(key);
+		entry.position = mProbation.begin();
+		entry.isProtected = false;
+		mProbationCost += entry.cost;
+	}
+
+	while (mProbationCost + mProtectedCost > mBudget)
+	{
+		const Segment &segment = mProbation.empty() ? mProtected : mProbation;
+		if (segment.empty())
+			break;
+		remove(mEntries.find(segment.back()));
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+
+#include <list>
+
+/**
+ * Bounded cache of the geometries and attribute rows decoded from the file of a lazily loaded
+ * store, shared by all copies of the store. Thread safe.
+ *
+ * Scans over a large file touch every record once, while maps and forms keep coming back to the
+ * same ones. Like a segmented LRU the cache has a probation and a protected segment: records enter
+ * probation and move to the protected segment, which holds up to PROTECTED_SHARE of the budget,
+ * once they are asked for again. A sequential scan thus only cycles through probation and leaves
+ * the records of the area being viewed in place. Consecutive lookups of one record, like the fields
+ * of a feature being read one by one, count as a single use.
+ */
+class QgsVctRecordCache
+{
+public:
+
+	//! Creates a cache holding up to \a budget bytes
+	explicit QgsVctRecordCache(qint64 budget);
+
+	qint64 budget() const { return mBudget; }
+	//! Estimated bytes held by the cached records
+	qint64 size() const;
+	//! Drops all records
+	void clear();
+
+	//! Copies the cached geometry of \a id to \a geometry, returns false on a miss
+	bool geometry(QgsFeatureId id, QgsGeometry &geometry);
+	//! Adds a decoded geometry of \a vertexCount vertices
+	void insertGeometry(QgsFeatureId id, const QgsGeometry &geometry, int vertexCount);
+
+	//! Copies the cached attribute row of \a id to \a attributes, returns false on a miss
+	bool attributes(QgsFeatureId id, QgsAttributes &attributes);
+	void insertAttributes(QgsFeatureId id, const QgsAttributes &attributes);
+
+private:
+
+	//protected records take at most this share of the budget, the rest is left to probation
+	static constexpr double PROTECTED_SHARE = 0.8;
+
+	enum Kind
+	{
+		Geometry,
+		Attributes,
+	};
+	typedef QPair<QgsFeatureId, int> Key;
+	typedef std::list<Key> Segment;
+
+	struct Entry
+	{
+		QgsGeometry geometry;
+		QgsAttributes attributes;
+		qint64 cost = 0;
+		bool isProtected = false;
+		Segment::iterator position;
+	};
+
+	//! Entry of \a key moved to the front of its segment, or of the protected one on reuse
+	const Entry *use(const Key &key);
+	void insert(const Key &key, Entry entry);
+	void remove(QHash<Key, Entry>::iterator it);
+	void evict();
+
+	const qint64 mBudget;
+	mutable QMutex mMutex;
+	QHash<Key, Entry> mEntries;
+	//most recently used first
+	Segment mProbation;
+	Segment mProtected;
+	qint64 mProbationCost = 0;
+	qint64 mProtectedCost = 0;
+	Key mLastKey = Key(FID_NULL, -1);
+};
@@ -21,7 +21,20 @@ QgsVctSourceSelect::QgsVctSourceSelect(QWidget *parent, Qt::WindowFlags fl, QgsP
 
 void QgsVctSourceSelect::addButtonClicked()
 {
-	emit addVectorLayer(lineEditFilePath->text(), lineEditLayerName->text());
+	const QString path = lineEditFilePath->text();
+	//the layers of all feature classes are created while the parse is held here, so they share it
+	const std::shared_ptr<QgsVctDataset> dataset = QgsVctDataset::open(path);
+	if (dataset->layerCount() <= 1)
+	{
+		emit addVectorLayer(path, lineEditLayerName->text());
+		return;
+	}
+	for (int i = 0; i < dataset->layerCount(); i++)
+	{
+		const QgsVctLayerContent layer = dataset->layer(i);
+		const QString name = layer.featureTypeName.isEmpty() ? dataset->layerNames().at(i) : layer.featureTypeName;
+		emit addVectorLayer(QgsVctProvider::encodeUri(path, dataset->layerNames().at(i)), QStringLiteral("%1 %2").arg(lineEditLayerName->text(), name));
+	}
 }
 
 void QgsVctSourceSelect::openFileDialog()
@@ -0,0 +1,196 @@
+#include "qgsvctstatistics.h"
+#include "qgsvctfeaturestore.h"
+#include "qgis.h"
+
+namespace
+{
+	//node of a hash and header of the data of a string
+	const qint64 HASH_NODE_OVERHEAD = 24;
+	const qint64 STRING_OVERHEAD = 24;
+
+	qint64 valueBytes(const QVariant &value)
+	{
+		if (value.type() == QVariant::String)
+			return STRING_OVERHEAD + qint64(value.toString().size()) * qint64(sizeof(QChar));
+		return 0;
+	}
+}
+
+QgsVctStatistics::Field &QgsVctStatistics::statistics(int field)
+{
+	if (field >= mFields.count())
+		mFields.resize(field + 1);
+	return mFields[field];
+}
+
+void QgsVctStatistics::addExtreme(Field &statistics, const QVariant &value, int count)
+{
+	if (statistics.minimum.isNull() || qgsVariantLessThan(value, statistics.minimum))
+	{
+		statistics.minimum = value;
+		statistics.minimumCount = count;
+	}
+	else if (value == statistics.minimum)
+		statistics.minimumCount += count;
+
+	if (statistics.maximum.isNull() || qgsVariantGreaterThan(value, statistics.maximum))
+	{
+		statistics.maximum = value;
+		statistics.maximumCount = count;
+	}
+	else if (value == statistics.maximum)
+		statistics.maximumCount += count;
+}
+
+void QgsVctStatistics::computeCounts(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset)
+{
+	Field &fieldStatistics = statistics(field);
+	fieldStatistics.counts.clear();
+	fieldStatistics.countsValid = true;
+
+	//dictionary encoded columns are counted on their codes
+	if (!subset && features.valueCounts(field, fieldStatistics.counts))
+		return;
+
+	if (subset)
+	{
+		for (QgsFeatureId id : *subset)
+		{
+			const int row = features.row(id);
+			if (row >= 0)
+				++fieldStatistics.counts[features.attribute(row, field)];
+		}
+		return;
+	}
+	for (int row = 0; row < features.count(); row++)
+		++fieldStatistics.counts[features.attribute(row, field)];
+}
+
+void QgsVctStatistics::computeExtremes(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset)
+{
+	//the distinct values of a dictionary are much fewer than its rows
+	if (!subset && features.isDictionaryEncoded(field) && !statistics(field).countsValid)
+		computeCounts(field, features, subset);
+
+	Field &fieldStatistics = statistics(field);
+	fieldStatistics.minimum = QVariant();
+	fieldStatistics.maximum = QVariant();
+	fieldStatistics.minimumCount = 0;
+	fieldStatistics.maximumCount = 0;
+	fieldStatistics.extremesValid = true;
+
+	if (fieldStatistics.countsValid)
+	{
+		for (QHash<QVariant, int>::const_iterator it = fieldStatistics.counts.constBegin(); it != fieldStatistics.counts.constEnd(); ++it)
+		{
+			if (!it.key().isNull())
+				addExtreme(fieldStatistics, it.key(), it.value());
+		}
+		return;
+	}
+
+	if (subset)
+	{
+		for (QgsFeatureId id : *subset)
+		{
+			const int row = features.row(id);
+			if (row < 0)
+				continue;
+			const QVariant value = features.attribute(row, field);
+			if (!value.isNull())
+				addExtreme(fieldStatistics, value, 1);
+		}
+		return;
+	}
+	for (int row = 0; row < features.count(); row++)
+	{
+		const QVariant value = features.attribute(row, field);
+		if (!value.isNull())
+			addExtreme(fieldStatistics, value, 1);
+	}
+}
+
+QVariant QgsVctStatistics::minimum(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset)
+{
+	if (!statistics(field).extremesValid)
+		computeExtremes(field, features, subset);
+	return mFields.at(field).minimum;
+}
+
+QVariant QgsVctStatistics::maximum(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset)
+{
+	if (!statistics(field).extremesValid)
+		computeExtremes(field, features, subset);
+	return mFields.at(field).maximum;
+}
+
+QSet<QVariant> QgsVctStatistics::uniqueValues(int field, int limit, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset)
+{
+	if (!statistics(field).countsValid)
+		computeCounts(field, features, subset);
+
+	QSet<QVariant> values;
+	const QHash<QVariant, int> &counts = mFields.at(field).counts;
+	for (QHash<QVariant, int>::const_iterator it = counts.constBegin(); it != counts.constEnd() && (limit < 0 || values.count() < limit); ++it)
+		values.insert(it.key());
+	return values;
+}
+
+qint64 QgsVctStatistics::memoryUsage() const
+{
+	qint64 bytes = qint64(mFields.capacity()) * qint64(sizeof(Field));
+	for (const Field &field : mFields)
+	{
+		bytes += valueBytes(field.minimum) + valueBytes(field.maximum);
+		bytes += qint64(field.counts.count()) * (qint64(sizeof(QVariant)) + qint64(sizeof(int)) + HASH_NODE_OVERHEAD);
+		for (QHash<QVariant, int>::const_iterator it = field.counts.constBegin(); it != field.counts.constEnd(); ++it)
+			bytes += valueBytes(it.key());
+	}
+	return bytes;
+}
+
+void QgsVctStatistics::addValue(int field, const QVariant &value)
+{
+	if (field < 0 || field >= mFields.count())
+		return;
+	Field &fieldStatistics = mFields[field];
+	if (fieldStatistics.extremesValid && !value.isNull())
+		addExtreme(fieldStatistics, value, 1);
+	if (fieldStatistics.countsValid)
+		++fieldStatistics.counts[value];
+}
+
+void QgsVctStatistics::removeValue(int field, const QVariant &value)
+{
+	if (field < 0 || field >= mFields.count())
+		return;
+	Field &fieldStatistics = mFields[field];
+	if (fieldStatistics.extremesValid && !value.isNull())
+	{
+		//the next extreme is unknown once the last occurrence is gone
+		if (value == fieldStatistics.minimum && --fieldStatistics.minimumCount == 0)
+			fieldStatistics.extremesValid = false;
+		if (value == fieldStatistics.maximum && --fieldStatistics.maximumCount == 0)
+			fieldStatistics.extremesValid = false;
+	}
+	if (fieldStatistics.countsValid)
+	{
+		const int count = fieldStatistics.counts.value(value) - 1;
+		if (count > 0)
+			fieldStatistics.counts[value] = count;
+		else
+			fieldStatistics.counts.remove(value);
+	}
+}
+
+void QgsVctStatistics::addRow(const QgsVctFeatureStore &features, int row)
+{
+	for (int field = 0; field < mFields.count(); field++)
+		addValue(field, features.attribute(row, field));
+}
+
+void QgsVctStatistics::removeRow(const QgsVctFeatureStore &features, int row)
+{
+	for (int field = 0; field < mFields.count(); field++)
+		removeValue(field, features.attribute(row, field));
+}
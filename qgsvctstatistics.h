@@ -0,0 +1,65 @@
+#pragma once
+
+#include "qgsfeature.h"
+
+#include <QHash>
+#include <QSet>
+#include <QVariant>
+#include <QVector>
+
+class QgsVctFeatureStore;
+
+/**
+ * Minimum, maximum and distinct values of the attribute fields of a VCT layer.
+ *
+ * The statistics of a field are computed from the feature store on the first request and then
+ * kept up to date by the edit functions of the provider. Extremes are counted, so removing one of
+ * several equal extremes costs nothing; removing the last one drops the field back to recomputation.
+ * Distinct values are counted only for fields they were asked for.
+ */
+class QgsVctStatistics
+{
+public:
+
+	//! Forgets everything, for example after the fields or the subset changed
+	void clear() { mFields.clear(); }
+	//! Estimated bytes held by the statistics, mostly the counts of distinct values
+	qint64 memoryUsage() const;
+
+	/**
+	 * Statistics over the rows of \a features, or over the features in \a subset when it is not null.
+	 * Nulls are ignored by the extremes and are a distinct value of their own.
+	 */
+	QVariant minimum(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset);
+	QVariant maximum(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset);
+	QSet<QVariant> uniqueValues(int field, int limit, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset);
+
+	//! Accounts for a value added to or removed from \a field
+	void addValue(int field, const QVariant &value);
+	void removeValue(int field, const QVariant &value);
+	//! Accounts for all values of \a row, call addRow() after adding and removeRow() before removing it
+	void addRow(const QgsVctFeatureStore &features, int row);
+	void removeRow(const QgsVctFeatureStore &features, int row);
+
+private:
+
+	struct Field
+	{
+		bool extremesValid = false;
+		//null while the field has no value
+		QVariant minimum;
+		QVariant maximum;
+		int minimumCount = 0;
+		int maximumCount = 0;
+
+		bool countsValid = false;
+		QHash<QVariant, int> counts;
+	};
+
+	Field &statistics(int field);
+	void computeExtremes(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset);
+	void computeCounts(int field, const QgsVctFeatureStore &features, const QVector<QgsFeatureId> *subset);
+	static void addExtreme(Field &statistics, const QVariant &value, int count);
+
+	QVector<Field> mFields;
+};
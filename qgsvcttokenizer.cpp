@@ -0,0 +1,122 @@
+#include "qgsvcttokenizer.h"
+
+QgsVctTokenizer::QgsVctTokenizer(const QString &path)
+	: mFile(path)
+{
+	if (!mFile.open(QIODevice::ReadOnly))
+		return;
+
+	const qint64 size = mFile.size();
+	if (size > 0)
+		mMap = mFile.map(0, size);
+	if (mMap)
+	{
+		mReader = vct::LineReader(reinterpret_cast<const char *>(mMap), size);
+	}
+	else
+	{
+		//mapping is not available (empty file, special file system): keep the content in memory
+		mBuffer = mFile.readAll();
+		mReader = vct::LineReader(mBuffer.constData(), mBuffer.size());
+	}
+	mValid = true;
+}
+
+QgsVctTokenizer::QgsVctTokenizer(const QgsVctTokenizer &source, qint64 begin, qint64 end)
+	: mReader(source.mReader, begin, end)
+	, mValid(source.mValid)
+{
+}
+
+QgsVctTokenizer::~QgsVctTokenizer()
+{
+	if (mMap)
+		mFile.unmap(mMap);
+}
+
+QList<QgsVctChunk> QgsVctTokenizer::scanChunks(qint64 chunkSize)
+{
+	QList<QgsVctChunk> chunks;
+	QgsVctChunk chunk;
+	QgsVctMarker sectionEnd = QgsVctMarker::None;
+	int terminator = 0;//0: inside a record, 1: after the "0" terminator, 2: after its blank line
+	bool tableName = false;
+	QString table;
+
+	while (!atEnd())
+	{
+		const qint64 lineStart = pos();
+		const QgsVctLine line = readLine();
+		const QgsVctMarker lineMarker = marker(line);
+		if (sectionEnd == QgsVctMarker::None)
+		{
+			sectionEnd = endMarker(lineMarker);
+			if (sectionEnd != QgsVctMarker::None)
+			{
+				chunk = QgsVctChunk();
+				chunk.section = lineMarker;
+				chunk.begin = pos();
+				terminator = 0;
+				tableName = true;
+			}
+			continue;
+		}
+		if (lineMarker == sectionEnd)
+		{
+			chunk.end = lineStart;
+			chunks.append(chunk);
+			sectionEnd = QgsVctMarker::None;
+			continue;
+		}
+
+		const bool full = lineStart - chunk.begin >= chunkSize;
+		switch (chunk.section)
+		{
+		case QgsVctMarker::PointBegin:
+		case QgsVctMarker::LineBegin:
+		case QgsVctMarker::PolygonBegin:
+		{
+			//records end with a "0" line followed by a blank line, the next one starts with its id
+			const bool blank = line.trimmed().isEmpty();
+			if (terminator == 2 && !blank && full)
+			{
+				chunk.end = lineStart;
+				chunks.append(chunk);
+				chunk.begin = lineStart;
+				chunk.continuation = true;
+			}
+			if (line.equals("0"))
+				terminator = 1;
+			else if (blank && terminator > 0)
+				terminator = 2;
+			else
+				terminator = 0;
+			break;
+		}
+		case QgsVctMarker::AttributeBegin:
+			if (tableName && lineMarker != QgsVctMarker::TableEnd)
+				table = line.trimmed().toString();
+			//rows are independent, but a table name has to stay with the rows following it
+			if (!tableName && lineMarker != QgsVctMarker::TableEnd && full)
+			{
+				chunk.end = lineStart;
+				chunks.append(chunk);
+				chunk.begin = lineStart;
+				chunk.continuation = true;
+				chunk.table = table;
+			}
+			tableName = lineMarker == QgsVctMarker::TableEnd;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (sectionEnd != QgsVctMarker::None)
+	{
+		//unterminated section at the end of the file
+		chunk.end = pos();
+		chunks.append(chunk);
+	}
+	return chunks;
+}
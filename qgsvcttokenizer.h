@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vctcore/vctline.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+#include <QList>
+
+typedef vct::Marker QgsVctMarker;
+
+//Byte range of a VCT section body that can be parsed on its own
+struct QgsVctChunk
+{
+	//! Begin marker of the section the chunk belongs to
+	QgsVctMarker section = QgsVctMarker::None;
+	qint64 begin = 0;
+	qint64 end = 0;
+	//! True when the chunk does not start at the beginning of its section
+	bool continuation = false;
+	//! Attribute table the rows at the start of a continuation chunk belong to
+	QString table;
+};
+
+/**
+ * One line of a VCT file, viewed in place inside the tokenizer buffer.
+ * The view does not own its bytes and stays valid as long as the tokenizer does.
+ */
+class QgsVctLine : public vct::Line
+{
+public:
+	QgsVctLine() = default;
+	QgsVctLine(const char *data, int size) : vct::Line(data, size) {}
+	QgsVctLine(const vct::Line &line) : vct::Line(line) {}
+
+	//! Returns the line without leading and trailing blanks
+	QgsVctLine trimmed() const { return vct::Line::trimmed(); }
+	QString toString() const { return QString::fromUtf8(data(), size()); }
+};
+
+/**
+ * Splits a VCT file into lines without copying it.
+ * The file is memory mapped, or read into memory when it can not be mapped, and its bytes are
+ * handed to the LineReader of the VCT core.
+ */
+class QgsVctTokenizer
+{
+public:
+	explicit QgsVctTokenizer(const QString &path);
+	//! Tokenizes the byte range [begin, end) of \a source, offsets stay relative to the whole file
+	QgsVctTokenizer(const QgsVctTokenizer &source, qint64 begin, qint64 end);
+	~QgsVctTokenizer();
+
+	QgsVctTokenizer(const QgsVctTokenizer &) = delete;
+	QgsVctTokenizer &operator=(const QgsVctTokenizer &) = delete;
+
+	bool isValid() const { return mValid; }
+	bool atEnd() const { return mReader.atEnd(); }
+	//! Byte offset of the next line
+	qint64 pos() const { return mReader.pos(); }
+	void seek(qint64 offset) { mReader.seek(offset); }
+	qint64 size() const { return mReader.size(); }
+	const char *data() const { return mReader.data(); }
+	//! Reader of the core parser over the bytes of the tokenizer
+	vct::LineReader &reader() { return mReader; }
+
+	//! Returns the next line without its terminator, a null line past the end
+	QgsVctLine readLine() { return mReader.readLine(); }
+	//! Number of lines returned by readLine()
+	qint64 lineCount() const { return mReader.lineCount(); }
+
+	/**
+	 * Scans the remaining lines for section boundaries. Point, line, polygon and attribute
+	 * sections are split at record boundaries into chunks of about \a chunkSize bytes.
+	 */
+	QList<QgsVctChunk> scanChunks(qint64 chunkSize);
+
+	//! Classifies a line as a section marker
+	static QgsVctMarker marker(const vct::Line &line) { return vct::marker(line); }
+	//! Returns the end marker matching a begin marker, None for other markers
+	static QgsVctMarker endMarker(QgsVctMarker begin) { return vct::endMarker(begin); }
+
+private:
+	QFile mFile;
+	uchar *mMap = nullptr;
+	QByteArray mBuffer;
+	vct::LineReader mReader;
+	bool mValid = false;
+};
@@ -0,0 +1,184 @@
+#include "qgsvcttrace.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutexLocker>
+#include <QObject>
+#include <QThread>
+
+namespace
+{
+	//Trace file named by QGIS_VCT_TRACE, opened by the first span
+	class QgsVctTraceFile
+	{
+	public:
+		QgsVctTraceFile()
+		{
+			const QString path = QString::fromLocal8Bit(qgetenv("QGIS_VCT_TRACE"));
+			if (path.isEmpty())
+				return;
+			mFile.setFileName(path);
+			if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+				return;
+			//the closing bracket is optional in the array format, events can be appended until the end
+			mFile.write("[\n");
+			mFile.flush();
+			mClock.start();
+			mOpen = true;
+		}
+
+		bool isOpen() const { return mOpen; }
+		//! Microseconds since the trace was started
+		qint64 now() const { return mClock.nsecsElapsed() / 1000; }
+
+		void write(const char *name, qint64 start, qint64 duration)
+		{
+			const QByteArray event = QStringLiteral("{\"name\":\"%1\",\"cat\":\"vct\",\"ph\":\"X\",\"ts\":%2,\"dur\":%3,\"pid\":%4,\"tid\":%5},\n")
+				.arg(QLatin1String(name)).arg(start).arg(duration).arg(QCoreApplication::applicationPid())
+				.arg(qulonglong(quintptr(QThread::currentThreadId()))).toUtf8();
+			QMutexLocker locker(&mMutex);
+			mFile.write(event);
+			mFile.flush();
+		}
+
+	private:
+		QMutex mMutex;
+		QFile mFile;
+		QElapsedTimer mClock;
+		bool mOpen = false;
+	};
+
+	QgsVctTraceFile &traceFile()
+	{
+		static QgsVctTraceFile file;
+		return file;
+	}
+
+	QString formatBytes(qint64 bytes)
+	{
+		if (bytes >= 1024 * 1024)
+			return QObject::tr("%1 MB").arg(double(bytes) / (1024 * 1024), 0, 'f', 1);
+		if (bytes >= 1024)
+			return QObject::tr("%1 KB").arg(double(bytes) / 1024, 0, 'f', 1);
+		return QObject::tr("%1 bytes").arg(bytes);
+	}
+}
+
+QgsVctProfile::QgsVctProfile()
+	: mCounters(CounterCount, 0)
+{
+}
+
+void QgsVctProfile::add(Counter counter, qint64 value)
+{
+	QMutexLocker locker(&mMutex);
+	mCounters[counter] += value;
+}
+
+qint64 QgsVctProfile::counter(Counter counter) const
+{
+	QMutexLocker locker(&mMutex);
+	return mCounters.at(counter);
+}
+
+void QgsVctProfile::addSpan(const char *name, qint64 nanoseconds)
+{
+	QMutexLocker locker(&mMutex);
+	SpanTotal &total = mSpans[QByteArray(name)];
+	++total.count;
+	total.nanoseconds += nanoseconds;
+}
+
+void QgsVctProfile::add(const QgsVctProfile &other)
+{
+	if (&other == this)
+		return;
+	QMap<QByteArray, SpanTotal> spans;
+	QVector<qint64> counters;
+	{
+		QMutexLocker locker(&other.mMutex);
+		spans = other.mSpans;
+		counters = other.mCounters;
+	}
+	QMutexLocker locker(&mMutex);
+	for (QMap<QByteArray, SpanTotal>::const_iterator it = spans.constBegin(); it != spans.constEnd(); ++it)
+	{
+		SpanTotal &total = mSpans[it.key()];
+		total.count += it->count;
+		total.nanoseconds += it->nanoseconds;
+	}
+	for (int i = 0; i < CounterCount; i++)
+		mCounters[i] += counters.at(i);
+}
+
+QString QgsVctProfile::toHtml() const
+{
+	QMutexLocker locker(&mMutex);
+	QString html;
+	for (QMap<QByteArray, SpanTotal>::const_iterator it = mSpans.constBegin(); it != mSpans.constEnd(); ++it)
+	{
+		html += QStringLiteral("<tr><td class=\"highlight\">%1</td><td>%2</td></tr>\n")
+			.arg(QString::fromLatin1(it.key()), QObject::tr("%1 ms in %2 runs").arg(double(it->nanoseconds) / 1e6, 0, 'f', 1).arg(it->count));
+	}
+
+	//throughput over the time of the spans that produced the counts
+	const double loadSeconds = double(mSpans.value("load").nanoseconds) / 1e9;
+	const double writeSeconds = double(mSpans.value("write").nanoseconds) / 1e9;
+	const double fetchSeconds = double(mSpans.value("fetchFeature").nanoseconds) / 1e9;
+	auto row = [&html](const QString &name, const QString &value)
+	{
+		html += QStringLiteral("<tr><td class=\"highlight\">%1</td><td>%2</td></tr>\n").arg(name, value);
+	};
+	if (mCounters.at(BytesRead))
+	{
+		QString value = formatBytes(mCounters.at(BytesRead));
+		if (loadSeconds > 0)
+			value += QObject::tr(", %1 MB/s").arg(double(mCounters.at(BytesRead)) / (1024 * 1024) / loadSeconds, 0, 'f', 1);
+		row(QObject::tr("Bytes read"), value);
+	}
+	if (mCounters.at(BytesWritten))
+	{
+		QString value = formatBytes(mCounters.at(BytesWritten));
+		if (writeSeconds > 0)
+			value += QObject::tr(", %1 MB/s").arg(double(mCounters.at(BytesWritten)) / (1024 * 1024) / writeSeconds, 0, 'f', 1);
+		row(QObject::tr("Bytes written"), value);
+	}
+	if (mCounters.at(Lines))
+		row(QObject::tr("Lines"), QString::number(mCounters.at(Lines)));
+	if (mCounters.at(Features))
+	{
+		QString value = QString::number(mCounters.at(Features));
+		const double seconds = fetchSeconds > 0 ? fetchSeconds : loadSeconds;
+		if (seconds > 0)
+			value += QObject::tr(", %1 features/s").arg(double(mCounters.at(Features)) / seconds, 0, 'f', 0);
+		row(QObject::tr("Features"), value);
+	}
+	if (mCounters.at(Vertices))
+		row(QObject::tr("Vertices"), QString::number(mCounters.at(Vertices)));
+	if (mCounters.at(AttributeRows))
+		row(QObject::tr("Attribute rows"), QString::number(mCounters.at(AttributeRows)));
+	return html;
+}
+
+QgsVctTraceSpan::QgsVctTraceSpan(const char *name, QgsVctProfile *profile)
+	: mName(name)
+	, mProfile(profile)
+{
+	if (isTracing())
+		mStart = traceFile().now();
+	mTimer.start();
+}
+
+QgsVctTraceSpan::~QgsVctTraceSpan()
+{
+	const qint64 nanoseconds = mTimer.nsecsElapsed();
+	if (mProfile)
+		mProfile->addSpan(mName, nanoseconds);
+	if (isTracing())
+		traceFile().write(mName, mStart, nanoseconds / 1000);
+}
+
+bool QgsVctTraceSpan::isTracing()
+{
+	return traceFile().isOpen();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/**
+ * Time spent in the hot paths of the provider and counts of what they processed.
+ *
+ * A profile collects the spans and counters of one area: the loads and saves of a dataset or
+ * the iterators of a provider. Spans with the same name are summed up. Hot loops count in
+ * locals and add them once per section, so a profile costs nothing per feature. Thread safe.
+ */
+class QgsVctProfile
+{
+public:
+
+	enum Counter
+	{
+		BytesRead,
+		BytesWritten,
+		Lines,
+		Features,
+		Vertices,
+		AttributeRows,
+		CounterCount,
+	};
+
+	QgsVctProfile();
+
+	void add(Counter counter, qint64 value);
+	qint64 counter(Counter counter) const;
+	//! Adds a run of the span \a name that took \a nanoseconds
+	void addSpan(const char *name, qint64 nanoseconds);
+	//! Adds the spans and counters of \a other
+	void add(const QgsVctProfile &other);
+
+	//! Rows of an HTML table with the spans and counters, as used in the layer metadata
+	QString toHtml() const;
+
+private:
+
+	struct SpanTotal
+	{
+		qint64 count = 0;
+		qint64 nanoseconds = 0;
+	};
+
+	mutable QMutex mMutex;
+	QMap<QByteArray, SpanTotal> mSpans;
+	QVector<qint64> mCounters;
+};
+
+/**
+ * Measures the scope it lives in and adds it to a profile.
+ *
+ * When the environment variable QGIS_VCT_TRACE names a file, every span is also written to it as
+ * a complete event of the Chrome trace format, which chrome://tracing and Perfetto show as a
+ * timeline per thread. Events are appended as spans end, so the file is usable while QGIS runs.
+ */
+class QgsVctTraceSpan
+{
+public:
+
+	//! Starts the span \a name, \a name has to outlive it
+	explicit QgsVctTraceSpan(const char *name, QgsVctProfile *profile = nullptr);
+	~QgsVctTraceSpan();
+
+	QgsVctTraceSpan(const QgsVctTraceSpan &) = delete;
+	QgsVctTraceSpan &operator=(const QgsVctTraceSpan &) = delete;
+
+	//! Whether spans are written to a trace file
+	static bool isTracing();
+
+private:
+
+	const char *mName;
+	QgsVctProfile *mProfile;
+	QElapsedTimer mTimer;
+	qint64 mStart = 0;
+};
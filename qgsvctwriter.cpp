@@ -0,0 +1,323 @@
+#include "qgsvctwriter.h"
+#include "vctcore/vctrecords.h"
+
+namespace
+{
+	//Feature and graphic code lines of a record, the layer code for features that were not read from a file
+	void writeRecordCodes(QgsVctWriter &writer, const QgsVctLayerContent &layer, int row)
+	{
+		const QByteArray featureCode = layer.features.featureCode(row);
+		const QByteArray graphicCode = layer.features.graphicCode(row);
+		if (featureCode.isEmpty())
+			writer.writeLine(layer.featureTypeCode);
+		else
+			writer.writeLine(featureCode);
+		//图形表现编码
+		if (graphicCode.isEmpty())
+			writer.writeLine(layer.featureTypeCode);
+		else
+			writer.writeLine(graphicCode);
+	}
+
+	//Copies the lazy record of row from the file it was read from, records without their text are dropped
+	void copyRecord(QgsVctWriter &writer, QgsVctFeatureStore &features, int row)
+	{
+		const QByteArray text = features.recordText(row);
+		if (text.isEmpty())
+		{
+			//the written file has no geometry for it either
+			features.moveRecord(row, -1, -1);
+			return;
+		}
+		const qint64 begin = writer.pos();
+		writer.write(text);
+		features.moveRecord(row, begin, writer.pos());
+		writer.write("0\n\n");
+	}
+
+	//the geometry of a record follows its id and code lines
+	void writePoints(QgsVctWriter &writer, QgsVctLayerContent &layer)
+	{
+		QgsVctFeatureStore &features = layer.features;
+		for (int row = 0; row < features.count(); row++)
+		{
+			if (features.hasLazyGeometry(row))
+			{
+				copyRecord(writer, features, row);
+				continue;
+			}
+			if (vct::recordVertexCount(features, row) == 0)
+				continue;
+			writer.writeIntegerLine(features.id(row));
+			writeRecordCodes(writer, layer, row);
+			vct::writePointGeometry(writer, features, row);
+		}
+	}
+
+	void writeLines(QgsVctWriter &writer, QgsVctLayerContent &layer)
+	{
+		QgsVctFeatureStore &features = layer.features;
+		for (int row = 0; row < features.count(); row++)
+		{
+			if (features.hasLazyGeometry(row))
+			{
+				copyRecord(writer, features, row);
+				continue;
+			}
+			writer.writeIntegerLine(features.id(row));
+			writeRecordCodes(writer, layer, row);
+			vct::writeLineGeometry(writer, features, row);
+		}
+	}
+
+	void writePolygons(QgsVctWriter &writer, QgsVctLayerContent &layer)
+	{
+		QgsVctFeatureStore &features = layer.features;
+		for (int row = 0; row < features.count(); row++)
+		{
+			if (features.hasLazyGeometry(row))
+			{
+				copyRecord(writer, features, row);
+				continue;
+			}
+			writer.writeIntegerLine(features.id(row));
+			writeRecordCodes(writer, layer, row);
+			vct::writePolygonGeometry(writer, features, row);
+		}
+	}
+
+	void writeTableStructure(QgsVctWriter &writer, const QgsVctLayerContent &layer)
+	{
+		writer.write(layer.attributeTableName);
+		writer.write(',');
+		writer.writeIntegerLine(layer.fields.size());
+		for (int i = 0; i < layer.fields.size(); i++)
+		{
+			const QgsField field = layer.fields.at(i);
+			writer.write(field.name());
+			writer.write(',');
+			writer.write(field.typeName());
+			//the width is kept for every type that declares one, the precision of floating point fields
+			if (field.typeName() == "Double")
+			{
+				writer.write(',');
+				writer.writeInteger(field.length());
+				writer.write(',');
+				writer.writeInteger(field.precision());
+			}
+			else if (field.length() > 0)
+			{
+				writer.write(',');
+				writer.writeInteger(field.length());
+			}
+			writer.write('\n');
+		}
+		writer.writeLine("0");
+	}
+
+	void writeAttributeTable(QgsVctWriter &writer, QgsVctLayerContent &layer)
+	{
+		QgsVctFeatureStore &features = layer.features;
+		writer.writeLine(layer.attributeTableName);
+		const int fieldCount = features.fieldCount();
+		for (int row = 0; row < features.count(); row++)
+		{
+			//deferred rows stay deferred, in the written file
+			const bool deferred = features.hasDeferredAttributes(row);
+			const qint64 begin = writer.pos();
+			if (deferred)
+			{
+				QByteArray text = features.attributeText(row);
+				if (!text.isEmpty())
+				{
+					if (!text.endsWith('\n'))
+						text.append('\n');
+					writer.write(text);
+					features.moveAttributes(row, begin, writer.pos());
+					continue;
+				}
+			}
+
+			writer.writeInteger(features.id(row));
+			for (int i = 0; i < fieldCount; i++)
+			{
+				writer.write(',');
+				if (features.hasConversionError(row, i))
+				{
+					writer.write(features.conversionErrorText(row, i));
+					continue;
+				}
+				const QVariant value = features.attribute(row, i);
+				if (value.isNull())
+					continue;
+				switch (value.type())
+				{
+				case QVariant::Int:
+				case QVariant::LongLong:
+					writer.writeInteger(value.toLongLong());
+					break;
+				case QVariant::Double:
+					writer.writeNumber(value.toDouble());
+					break;
+				default:
+					writer.write(value.toString());
+					break;
+				}
+			}
+			writer.write('\n');
+			if (deferred)
+				features.moveAttributes(row, begin, writer.pos());
+		}
+		writer.writeLine("TableEnd");
+	}
+}
+
+QgsVctWriter::QgsVctWriter(const QString &path)
+	: mFile(path)
+{
+	mBuffer.reserve(BLOCK_SIZE + 64 * 1024);
+}
+
+bool QgsVctWriter::open()
+{
+	mOk = mFile.open(QIODevice::WriteOnly);
+	return mOk;
+}
+
+void QgsVctWriter::flush()
+{
+	if (mOk && !mBuffer.isEmpty())
+		mOk = mFile.write(mBuffer) == mBuffer.size();
+	mWritten += mBuffer.size();
+	mBuffer.resize(0);
+}
+
+bool QgsVctWriter::commit()
+{
+	flush();
+	if (!mOk)
+	{
+		mFile.cancelWriting();
+		mFile.commit();
+		return false;
+	}
+	return mFile.commit();
+}
+
+void QgsVctWriter::writeInteger(qint64 value)
+{
+	char text[vct::MAX_NUMBER_SIZE];
+	mBuffer.append(text, vct::formatInteger(value, text));
+}
+
+void QgsVctWriter::writeNumber(double value)
+{
+	char text[vct::MAX_NUMBER_SIZE];
+	mBuffer.append(text, vct::formatNumber(value, text));
+}
+
+void QgsVctWriter::writeCoordinate(double x, double y)
+{
+	writeNumber(x);
+	mBuffer.append(',');
+	writeNumber(y);
+	mBuffer.append('\n');
+	flushIfFull();
+}
+
+bool QgsVctWriter::writeFile(QgsVctFileContent &content, QString &error, QgsVctProfile *profile)
+{
+	QgsVctTraceSpan span("writeFile", profile);
+	QgsVctWriter writer(content.path);
+	if (!writer.open())
+	{
+		error = writer.errorString();
+		return false;
+	}
+
+	writer.writeLine("HeadBegin");
+	for (const QString &head : content.head)
+		writer.writeLine(head);
+	writer.writeLine("HeadEnd");
+
+	writer.writeLine("FeatureCodeBegin");
+	for (const QgsVctLayerContent &layer : content.layers)
+	{
+		const char *geometryName = nullptr;
+		if (layer.geometryType == QgsWkbTypes::PointGeometry)
+			geometryName = "Point,";
+		else if (layer.geometryType == QgsWkbTypes::LineGeometry)
+			geometryName = "Line,";
+		else if (layer.geometryType == QgsWkbTypes::PolygonGeometry)
+			geometryName = "Polygon,";
+		if (!geometryName)
+			continue;
+		writer.write(layer.featureTypeCode);
+		writer.write(',');
+		writer.write(layer.featureTypeName);
+		writer.write(',');
+		writer.write(geometryName);
+		writer.writeLine(layer.attributeTableName);
+	}
+	for (const QString &item : content.customItems)
+		writer.writeLine(item);
+	writer.writeLine("FeatureCodeEnd");
+
+	writer.writeLine("TableStructureBegin");
+	for (const QgsVctLayerContent &layer : content.layers)
+		writeTableStructure(writer, layer);
+	writer.writeLine("TableStructureEnd");
+
+	//the records of all classes of a geometry type share one section
+	writer.writeLine("PointBegin");
+	{
+		QgsVctTraceSpan sectionSpan("writePoints", profile);
+		for (QgsVctLayerContent &layer : content.layers)
+		{
+			if (layer.geometryType == QgsWkbTypes::PointGeometry)
+				writePoints(writer, layer);
+		}
+	}
+	writer.writeLine("PointEnd");
+
+	writer.writeLine("LineBegin");
+	{
+		QgsVctTraceSpan sectionSpan("writeLines", profile);
+		for (QgsVctLayerContent &layer : content.layers)
+		{
+			if (layer.geometryType == QgsWkbTypes::LineGeometry)
+				writeLines(writer, layer);
+		}
+	}
+	writer.writeLine("LineEnd");
+
+	writer.writeLine("PolygonBegin");
+	{
+		QgsVctTraceSpan sectionSpan("writePolygons", profile);
+		for (QgsVctLayerContent &layer : content.layers)
+		{
+			if (layer.geometryType == QgsWkbTypes::PolygonGeometry)
+				writePolygons(writer, layer);
+		}
+	}
+	writer.writeLine("PolygonEnd");
+
+	writer.writeLine("AnnotationBegin");
+	writer.writeLine("AnnotationEnd");
+
+	writer.writeLine("AttributeBegin");
+	{
+		QgsVctTraceSpan sectionSpan("writeAttributes", profile);
+		for (QgsVctLayerContent &layer : content.layers)
+			writeAttributeTable(writer, layer);
+	}
+	writer.writeLine("AttributeEnd");
+
+	QgsVctTraceSpan commitSpan("commit", profile);
+	if (!writer.commit())
+	{
+		error = writer.errorString();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "qgsfields.h"
+#include "qgswkbtypes.h"
+#include "qgsvctfeaturestore.h"
+#include "qgsvcttrace.h"
+
+#include <QByteArray>
+#include <QSaveFile>
+#include <QString>
+#include <QVector>
+
+/**
+ * One feature class of a VCT file: its entry in the feature code section, its attribute table
+ * and its features.
+ */
+struct QgsVctLayerContent
+{
+	QString featureTypeCode;
+	QString featureTypeName;
+	QString attributeTableName;
+	QgsWkbTypes::Type wkbType = QgsWkbTypes::NoGeometry;
+	QgsWkbTypes::GeometryType geometryType = QgsWkbTypes::UnknownGeometry;
+	QgsFields fields;
+	//lazy records are copied from the file the store was read from
+	QgsVctFeatureStore features;
+};
+
+/**
+ * Everything that is written to a VCT file. Copies share their containers with the
+ * provider, so taking one to write it on another thread is cheap.
+ */
+struct QgsVctFileContent
+{
+	QString path;
+	QVector<QString> head;
+	//lines of the feature code section that do not declare a point, line or polygon class
+	QVector<QString> customItems;
+	QVector<QgsVctLayerContent> layers;
+};
+
+/**
+ * Buffered output of a VCT file.
+ *
+ * Text is collected in large blocks and written to a temporary file that replaces the target
+ * only in commit(), so a crash or an error leaves the previous file untouched. Numbers are
+ * formatted without QString or QTextStream: integers directly, doubles in their shortest form
+ * that reads back to the same value.
+ */
+class QgsVctWriter
+{
+public:
+
+	explicit QgsVctWriter(const QString &path);
+
+	/**
+	 * Writes \a content to its path, returns false and sets \a error on failure. The time of each
+	 * section is added to \a profile. Lazy records are copied as text from the file their store was
+	 * read from and moved to their range in the written file, see QgsVctFeatureStore::replaceFile().
+	 * Only changes \a content, so it can run on any thread with a copy of it.
+	 */
+	static bool writeFile(QgsVctFileContent &content, QString &error, QgsVctProfile *profile = nullptr);
+
+	bool open();
+	//! Writes the remaining buffer and atomically replaces the target file
+	bool commit();
+	QString errorString() const { return mFile.errorString(); }
+	//! Offset in the file of the next byte written
+	qint64 pos() const { return mWritten + mBuffer.size(); }
+
+	void write(const char *text) { mBuffer.append(text); flushIfFull(); }
+	void write(char c) { mBuffer.append(c); }
+	void write(const QString &text) { mBuffer.append(text.toUtf8()); flushIfFull(); }
+	void write(const QByteArray &text) { mBuffer.append(text); flushIfFull(); }
+	void writeInteger(qint64 value);
+	void writeNumber(double value);
+	//! Writes a coordinate line "x,y"
+	void writeCoordinate(double x, double y);
+
+	//! Writes \a text followed by a line break
+	template <typename T>
+	void writeLine(const T &text)
+	{
+		write(text);
+		write('\n');
+	}
+	void writeIntegerLine(qint64 value)
+	{
+		writeInteger(value);
+		write('\n');
+	}
+
+private:
+
+	void flushIfFull()
+	{
+		if (mBuffer.size() >= BLOCK_SIZE)
+			flush();
+	}
+	void flush();
+
+	static const int BLOCK_SIZE = 4 * 1024 * 1024;
+
+	QSaveFile mFile;
+	QByteArray mBuffer;
+	qint64 mWritten = 0;
+	bool mOk = true;
+};
@@ -0,0 +1,274 @@
+// Benchmarks of the VCT core on a synthetic corpus, see vctcorpus.h. Corpus options come before the
+// options of Google Benchmark:
+//
+//   vctbench --features=100000 --decimals=17 --benchmark_filter=Read
+//
+// Throughput is reported as bytes_per_second and features per second, peak_rss is the peak resident
+// set size of the process after the benchmark.
+
+#include "vctcorpus.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+	vct::CorpusOptions sOptions;
+
+	const std::string &corpus()
+	{
+		static const std::string text = vct::generateCorpusText(sOptions);
+		return text;
+	}
+
+	double peakResidentSetSize()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return 0;
+		return double(counters.PeakWorkingSetSize);
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+#ifdef __APPLE__
+		return double(usage.ru_maxrss);
+#else
+		return double(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	}
+
+	void setCounters(benchmark::State &state, size_t bytes, int features)
+	{
+		state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(bytes));
+		if (features > 0)
+			state.counters["features"] = benchmark::Counter(features, benchmark::Counter::kIsIterationInvariantRate);
+		state.counters["peak_rss"] = benchmark::Counter(peakResidentSetSize(), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+	}
+
+	/**
+	 * Number texts of coordinates: with 3 decimals they take the fast path of parseDouble(), with all
+	 * 17 significant digits the correctly rounded fallback.
+	 */
+	std::vector<std::string> numberTexts(bool allDigits)
+	{
+		std::mt19937_64 engine(sOptions.seed);
+		std::vector<std::string> texts;
+		texts.reserve(4096);
+		for (int i = 0; i < 4096; i++)
+		{
+			const double value = 500000 + double(engine() >> 11) * (100000.0 / 9007199254740992.0);
+			char text[64];
+			if (allDigits)
+				snprintf(text, sizeof(text), "%.17g", value);
+			else
+				snprintf(text, sizeof(text), "%.3f", value);
+			texts.push_back(text);
+		}
+		return texts;
+	}
+
+	//Record sink that only counts, so the readers are measured without a store
+	class CountingSink
+	{
+	public:
+		void beginRecord(int, const vct::Line &, const vct::Line &, vct::GeometryType, int64_t) { ++records; }
+		void beginPart() {}
+		void beginRing() {}
+		void addVertex(double x, double y) { sum += x + y; }
+		void endRecord(int64_t) {}
+
+		int records = 0;
+		double sum = 0;
+	};
+
+	//Stream buffer that drops its output, the writers are measured without a file
+	class NullBuffer : public std::streambuf
+	{
+	protected:
+		std::streamsize xsputn(const char *, std::streamsize count) override { return count; }
+		int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+	};
+}
+
+static void BM_LineReader(benchmark::State &state)
+{
+	const std::string &text = corpus();
+	for (auto _ : state)
+	{
+		vct::LineReader reader(text.data(), int64_t(text.size()));
+		int64_t bytes = 0;
+		for (vct::Line line = reader.readLine(); !line.isNull(); line = reader.readLine())
+			bytes += line.size();
+		benchmark::DoNotOptimize(bytes);
+	}
+	setCounters(state, text.size(), 0);
+}
+BENCHMARK(BM_LineReader);
+
+static void BM_ParseDouble(benchmark::State &state)
+{
+	const std::vector<std::string> texts = numberTexts(state.range(0) != 0);
+	size_t bytes = 0;
+	for (const std::string &text : texts)
+		bytes += text.size();
+	for (auto _ : state)
+	{
+		for (const std::string &text : texts)
+		{
+			double value;
+			vct::parseDouble(text.data(), text.data() + text.size(), value);
+			benchmark::DoNotOptimize(value);
+		}
+	}
+	setCounters(state, bytes, 0);
+	state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(texts.size()));
+}
+BENCHMARK(BM_ParseDouble)->ArgName("allDigits")->Arg(0)->Arg(1);
+
+static void BM_ParseCoordinate(benchmark::State &state)
+{
+	const std::vector<std::string> numbers = numberTexts(state.range(0) != 0);
+	std::vector<std::string> lines;
+	size_t bytes = 0;
+	for (size_t i = 0; i + 1 < numbers.size(); i += 2)
+	{
+		lines.push_back(numbers[i] + ',' + numbers[i + 1]);
+		bytes += lines.back().size();
+	}
+	for (auto _ : state)
+	{
+		for (const std::string &line : lines)
+		{
+			double xyz[3];
+			vct::parseCoordinate(line.data(), line.data() + line.size(), xyz);
+			benchmark::DoNotOptimize(xyz);
+		}
+	}
+	setCounters(state, bytes, 0);
+	state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(lines.size()));
+}
+BENCHMARK(BM_ParseCoordinate)->ArgName("allDigits")->Arg(0)->Arg(1);
+
+static void BM_FormatNumber(benchmark::State &state)
+{
+	std::vector<double> values;
+	for (const std::string &text : numberTexts(state.range(0) != 0))
+	{
+		double value;
+		vct::parseDouble(text.data(), text.data() + text.size(), value);
+		values.push_back(value);
+	}
+	for (auto _ : state)
+	{
+		for (double value : values)
+		{
+			char text[vct::MAX_NUMBER_SIZE];
+			benchmark::DoNotOptimize(vct::formatNumber(value, text));
+		}
+	}
+	state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(values.size()));
+}
+BENCHMARK(BM_FormatNumber)->ArgName("allDigits")->Arg(0)->Arg(1);
+
+//Reads the section of the corpus that starts with the \a begin marker
+template <void (*Read)(vct::LineReader &, CountingSink &)>
+static void readSection(benchmark::State &state, const char *begin, int features)
+{
+	const std::string &text = corpus();
+	const size_t marker = text.find(begin);
+	const int64_t sectionBegin = int64_t(marker + strlen(begin));
+	vct::LineReader source(text.data(), int64_t(text.size()));
+	int64_t sectionEnd = 0;
+	for (auto _ : state)
+	{
+		vct::LineReader reader(source, sectionBegin, source.size());
+		CountingSink sink;
+		Read(reader, sink);
+		benchmark::DoNotOptimize(sink.sum);
+		sectionEnd = reader.pos();
+	}
+	setCounters(state, size_t(sectionEnd - sectionBegin), features);
+}
+
+static void BM_ReadPoints(benchmark::State &state)
+{
+	readSection<vct::readPoints<CountingSink>>(state, "\nPointBegin\n", sOptions.pointCount);
+}
+BENCHMARK(BM_ReadPoints);
+
+static void BM_ReadLines(benchmark::State &state)
+{
+	readSection<vct::readLines<CountingSink>>(state, "\nLineBegin\n", sOptions.lineCount);
+}
+BENCHMARK(BM_ReadLines);
+
+static void BM_ReadPolygons(benchmark::State &state)
+{
+	readSection<vct::readPolygons<CountingSink>>(state, "\nPolygonBegin\n", sOptions.polygonCount);
+}
+BENCHMARK(BM_ReadPolygons);
+
+static void BM_ReadFile(benchmark::State &state)
+{
+	const std::string &text = corpus();
+	for (auto _ : state)
+	{
+		vct::File file;
+		vct::LineReader reader(text.data(), int64_t(text.size()));
+		vct::readFile(reader, file);
+		benchmark::DoNotOptimize(file.records.count());
+	}
+	setCounters(state, text.size(), sOptions.featureCount());
+}
+BENCHMARK(BM_ReadFile)->Unit(benchmark::kMillisecond);
+
+static void BM_WriteFile(benchmark::State &state)
+{
+	vct::File file;
+	vct::generateCorpus(sOptions, file);
+	NullBuffer buffer;
+	std::ostream out(&buffer);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(vct::writeFile(file, out));
+	setCounters(state, corpus().size(), sOptions.featureCount());
+}
+BENCHMARK(BM_WriteFile)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv)
+{
+	//the corpus options are taken out before Google Benchmark sees the others
+	int count = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!vct::parseCorpusOption(argv[i], sOptions))
+			argv[count++] = argv[i];
+	}
+	argc = count;
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+	{
+		std::cerr << "corpus options:\n" << vct::corpusOptionsUsage();
+		return 2;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
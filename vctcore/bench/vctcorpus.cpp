@@ -0,0 +1,302 @@
+#include "vctcorpus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+namespace
+{
+	//the Gauss-Kruger coordinates of a map sheet, their size is the one of real survey data
+	const double ORIGIN_X = 500000;
+	const double ORIGIN_Y = 3000000;
+	const double EXTENT = 100000;
+	const double PI = 3.14159265358979323846;
+
+	/**
+	 * Random numbers from the bits of mt19937_64, whose sequence is fixed by the standard. The
+	 * distributions of <random> are not, they differ between standard libraries.
+	 */
+	class Random
+	{
+	public:
+		explicit Random(uint64_t seed) : mEngine(seed) {}
+
+		//! Uniform in [0, 1)
+		double unit() { return double(mEngine() >> 11) * (1.0 / 9007199254740992.0); }
+		double uniform(double min, double max) { return min + (max - min) * unit(); }
+		//! Uniform in [0, count)
+		int index(int count) { return int(mEngine() % uint64_t(count)); }
+
+	private:
+		std::mt19937_64 mEngine;
+	};
+
+	class Generator
+	{
+	public:
+		Generator(const vct::CorpusOptions &options, vct::File &file)
+			: mOptions(options)
+			, mFile(file)
+			, mRandom(options.seed)
+			, mScale(std::pow(10.0, options.coordinateDecimals))
+		{
+		}
+
+		void run()
+		{
+			mFile.head.push_back("DataMark:CNSDTF-VCT");
+			mFile.head.push_back("Version:3.0");
+			mFile.head.push_back("CoordinateSystemType:P");
+			mFile.head.push_back("Dim:2");
+			mFile.head.push_back("XAxisDirection:E");
+			mFile.head.push_back("YAxisDirection:N");
+			mFile.head.push_back("XYUnit:M");
+
+			addClass("1001", "Well", vct::GeometryType::Point, "WELL");
+			addClass("2001", "Road", vct::GeometryType::Line, "ROAD");
+			addClass("3001", "Parcel", vct::GeometryType::Polygon, "PARCEL");
+
+			for (int i = 0; i < mOptions.pointCount; i++)
+				addPoint(mFile.attributeTables[0]);
+			for (int i = 0; i < mOptions.lineCount; i++)
+				addLine(mFile.attributeTables[1]);
+			for (int i = 0; i < mOptions.polygonCount; i++)
+				addPolygon(mFile.attributeTables[2]);
+		}
+
+	private:
+		void addClass(const char *code, const char *name, vct::GeometryType type, const char *table)
+		{
+			vct::FeatureClass featureClass;
+			featureClass.code = code;
+			featureClass.name = name;
+			featureClass.geometryType = type;
+			featureClass.table = table;
+			mFile.featureClasses.push_back(featureClass);
+
+			//the columns cycle through the field types of the provider
+			vct::TableStructure structure;
+			structure.name = table;
+			for (int column = 0; column < mOptions.attributeColumns; column++)
+			{
+				vct::Field field;
+				field.name = "F" + std::to_string(column + 1);
+				switch (column % 4)
+				{
+				case 0:
+					field.type = "Char";
+					field.length = 16;
+					break;
+				case 1:
+					field.type = "Int4";
+					break;
+				case 2:
+					field.type = "Double";
+					field.length = 12;
+					field.precision = 2;
+					break;
+				default:
+					field.type = "Date";
+					break;
+				}
+				structure.fields.push_back(field);
+			}
+			mFile.tables.push_back(structure);
+
+			mFile.attributeTables.emplace_back();
+			mFile.attributeTables.back().name = table;
+		}
+
+		double coordinate(double value) const
+		{
+			return mOptions.coordinateDecimals >= 17 ? value : std::round(value * mScale) / mScale;
+		}
+
+		void addVertex(double x, double y)
+		{
+			mFile.records.addVertex(coordinate(x), coordinate(y));
+		}
+
+		void beginRecord(const char *code, vct::GeometryType type, vct::AttributeTable &table)
+		{
+			const vct::Line featureCode(code, int(strlen(code)));
+			mFile.records.beginRecord(++mLastId, featureCode, featureCode, type);
+			addAttributeRow(table);
+		}
+
+		void addAttributeRow(vct::AttributeTable &table)
+		{
+			table.addRow(mLastId);
+			for (int column = 0; column < mOptions.attributeColumns; column++)
+			{
+				char text[32];
+				switch (column % 4)
+				{
+				case 0:
+					snprintf(text, sizeof(text), "N%08d", mRandom.index(100000000));
+					break;
+				case 1:
+					snprintf(text, sizeof(text), "%d", mRandom.index(100000));
+					break;
+				case 2:
+					snprintf(text, sizeof(text), "%d.%02d", mRandom.index(10000), mRandom.index(100));
+					break;
+				default:
+					snprintf(text, sizeof(text), "20%02d-%02d-%02d", mRandom.index(25), 1 + mRandom.index(12), 1 + mRandom.index(28));
+					break;
+				}
+				table.values.push_back(text);
+			}
+		}
+
+		void addPoint(vct::AttributeTable &table)
+		{
+			beginRecord("1001", vct::GeometryType::Point, table);
+			mFile.records.beginPart();
+			mFile.records.beginRing();
+			addVertex(ORIGIN_X + mRandom.uniform(0, EXTENT), ORIGIN_Y + mRandom.uniform(0, EXTENT));
+			mFile.records.endRecord();
+		}
+
+		//a random walk of verticesPerFeature vertices
+		void addLine(vct::AttributeTable &table)
+		{
+			beginRecord("2001", vct::GeometryType::Line, table);
+			mFile.records.beginPart();
+			mFile.records.beginRing();
+			double x = ORIGIN_X + mRandom.uniform(0, EXTENT);
+			double y = ORIGIN_Y + mRandom.uniform(0, EXTENT);
+			double heading = mRandom.uniform(0, 2 * PI);
+			const int vertexCount = std::max(2, mOptions.verticesPerFeature);
+			for (int i = 0; i < vertexCount; i++)
+			{
+				addVertex(x, y);
+				heading += mRandom.uniform(-0.5, 0.5);
+				const double step = mRandom.uniform(5, 50);
+				x += step * std::cos(heading);
+				y += step * std::sin(heading);
+			}
+			mFile.records.endRecord();
+		}
+
+		//closed ring of vertexCount vertices around (x, y), the radius varies by a fifth
+		void addRing(double x, double y, double radius, int vertexCount, bool clockwise)
+		{
+			mFile.records.beginRing();
+			const double direction = clockwise ? -1 : 1;
+			double firstX = 0;
+			double firstY = 0;
+			for (int i = 0; i < vertexCount - 1; i++)
+			{
+				const double angle = direction * 2 * PI * i / (vertexCount - 1);
+				const double r = radius * mRandom.uniform(0.8, 1);
+				const double vertexX = coordinate(x + r * std::cos(angle));
+				const double vertexY = coordinate(y + r * std::sin(angle));
+				if (i == 0)
+				{
+					firstX = vertexX;
+					firstY = vertexY;
+				}
+				mFile.records.addVertex(vertexX, vertexY);
+			}
+			mFile.records.addVertex(firstX, firstY);
+		}
+
+		//outer ring with holesPerPolygon holes set on a circle inside of it
+		void addPolygon(vct::AttributeTable &table)
+		{
+			beginRecord("3001", vct::GeometryType::Polygon, table);
+			mFile.records.beginPart();
+			const double x = ORIGIN_X + mRandom.uniform(0, EXTENT);
+			const double y = ORIGIN_Y + mRandom.uniform(0, EXTENT);
+			const double radius = mRandom.uniform(50, 200);
+			addRing(x, y, radius, std::max(4, mOptions.verticesPerFeature), false);
+			const int holeCount = mOptions.holesPerPolygon;
+			const double holeRadius = radius * std::min(0.3, 0.4 * std::sin(PI / std::max(2, holeCount)));
+			for (int hole = 0; hole < holeCount; hole++)
+			{
+				const double angle = 2 * PI * hole / holeCount;
+				const double distance = holeCount > 1 ? radius * 0.45 : 0;
+				addRing(x + distance * std::cos(angle), y + distance * std::sin(angle), holeRadius,
+					std::max(4, mOptions.verticesPerFeature / 4), true);
+			}
+			mFile.records.endRecord();
+		}
+
+		const vct::CorpusOptions &mOptions;
+		vct::File &mFile;
+		Random mRandom;
+		const double mScale;
+		int mLastId = 0;
+	};
+
+	bool readOption(const char *argument, const char *name, long long &value)
+	{
+		const size_t length = strlen(name);
+		if (strncmp(argument, "--", 2) != 0 || strncmp(argument + 2, name, length) != 0 || argument[2 + length] != '=')
+			return false;
+		value = strtoll(argument + 3 + length, nullptr, 10);
+		return true;
+	}
+}
+
+namespace vct
+{
+	bool parseCorpusOption(const char *argument, CorpusOptions &options)
+	{
+		long long value = 0;
+		if (readOption(argument, "seed", value))
+			options.seed = uint64_t(value);
+		else if (readOption(argument, "points", value))
+			options.pointCount = int(std::max(0LL, value));
+		else if (readOption(argument, "lines", value))
+			options.lineCount = int(std::max(0LL, value));
+		else if (readOption(argument, "polygons", value))
+			options.polygonCount = int(std::max(0LL, value));
+		else if (readOption(argument, "features", value))
+			options.pointCount = options.lineCount = options.polygonCount = int(std::max(0LL, value));
+		else if (readOption(argument, "vertices", value))
+			options.verticesPerFeature = int(std::max(0LL, value));
+		else if (readOption(argument, "holes", value))
+			options.holesPerPolygon = int(std::max(0LL, value));
+		else if (readOption(argument, "columns", value))
+			options.attributeColumns = int(std::max(0LL, value));
+		else if (readOption(argument, "decimals", value))
+			options.coordinateDecimals = int(std::min(17LL, std::max(0LL, value)));
+		else
+			return false;
+		return true;
+	}
+
+	const char *corpusOptionsUsage()
+	{
+		return
+			"  --seed=N       seed of the generator (1)\n"
+			"  --points=N     point features (10000)\n"
+			"  --lines=N      line features (10000)\n"
+			"  --polygons=N   polygon features (10000)\n"
+			"  --features=N   sets the points, lines and polygons\n"
+			"  --vertices=N   vertices per line and outer ring (32)\n"
+			"  --holes=N      holes per polygon (1)\n"
+			"  --columns=N    attribute columns per table (8)\n"
+			"  --decimals=N   decimals of the coordinates, 17 for all digits (3)\n";
+	}
+
+	void generateCorpus(const CorpusOptions &options, File &file)
+	{
+		Generator(options, file).run();
+	}
+
+	std::string generateCorpusText(const CorpusOptions &options)
+	{
+		File file;
+		generateCorpus(options, file);
+		std::ostringstream out;
+		writeFile(file, out);
+		return out.str();
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vctfile.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Synthetic VCT corpus for the benchmarks. The corpus only depends on its options: the same seed
+ * gives the same bytes on every platform, so numbers measured on different machines or commits
+ * compare the same input.
+ */
+namespace vct
+{
+	struct CorpusOptions
+	{
+		uint64_t seed = 1;
+		int pointCount = 10000;
+		int lineCount = 10000;
+		int polygonCount = 10000;
+		//vertices of a line and of the outer ring of a polygon, holes get a quarter of them
+		int verticesPerFeature = 32;
+		int holesPerPolygon = 1;
+		//columns of each attribute table besides the feature id
+		int attributeColumns = 8;
+		//decimals of the coordinates, 17 keeps every digit of the generated doubles
+		int coordinateDecimals = 3;
+
+		int featureCount() const { return pointCount + lineCount + polygonCount; }
+	};
+
+	/**
+	 * Parses a "--name=value" option of the corpus into \a options, where name is seed, points, lines,
+	 * polygons, features (all three counts), vertices, holes, columns or decimals. Returns false when
+	 * \a argument is not a corpus option.
+	 */
+	bool parseCorpusOption(const char *argument, CorpusOptions &options);
+	//! Usage text of the corpus options
+	const char *corpusOptionsUsage();
+
+	//! Builds a corpus with a point, a line and a polygon class, each with its attribute table
+	void generateCorpus(const CorpusOptions &options, File &file);
+	//! Returns the VCT text of the corpus
+	std::string generateCorpusText(const CorpusOptions &options);
+}
@@ -0,0 +1,41 @@
+// Writes a synthetic VCT corpus, the same options always give the same file:
+//
+//   vctgen corpus.vct --features=100000 --vertices=64 --holes=2 --columns=12
+
+#include "vctcorpus.h"
+
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+	vct::CorpusOptions options;
+	const char *path = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (vct::parseCorpusOption(argv[i], options))
+			continue;
+		if (argv[i][0] == '-' || path)
+		{
+			std::cerr << "usage: vctgen <output.vct> [options]\n" << vct::corpusOptionsUsage();
+			return 2;
+		}
+		path = argv[i];
+	}
+	if (!path)
+	{
+		std::cerr << "usage: vctgen <output.vct> [options]\n" << vct::corpusOptionsUsage();
+		return 2;
+	}
+
+	vct::File file;
+	vct::generateCorpus(options, file);
+	std::ofstream out(path, std::ios::binary);
+	if (!out || !vct::writeFile(file, out))
+	{
+		std::cerr << "vctgen: can not write " << path << std::endl;
+		return 1;
+	}
+	std::cout << path << ": " << options.featureCount() << " features, " << file.records.vertexCount() << " vertices" << std::endl;
+	return 0;
+}
@@ -0,0 +1,115 @@
+// Round trip of the VCT core: a file read and written again keeps its structure.
+// Registered with CTest by vctcore/CMakeLists.txt.
+
+#include "vctfile.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+	int sFailures = 0;
+
+	void check(bool condition, const char *what)
+	{
+		if (!condition)
+		{
+			std::cerr << "FAIL: " << what << std::endl;
+			++sFailures;
+		}
+	}
+
+	std::string roundTrip(const std::string &text, vct::File &file)
+	{
+		vct::LineReader reader(text.data(), int64_t(text.size()));
+		vct::readFile(reader, file);
+		std::ostringstream out;
+		vct::writeFile(file, out);
+		return out.str();
+	}
+
+	const char *const SOURCE =
+		"HeadBegin\n"
+		"DataMark:CNSDTF-VCT\n"
+		"HeadEnd\n"
+		"FeatureCodeBegin\n"
+		"1001,Well,Point,WELL\n"
+		"FeatureCodeEnd\n"
+		"TableStructureBegin\n"
+		"WELL,3\n"
+		"NAME,Char,10\n"
+		"DEPTH,Double,10,2\n"
+		"SURVEYED,Date\n"
+		"0\n"
+		"TableStructureEnd\n"
+		"PointBegin\n"
+		"1\n"
+		"1001\n"
+		"G1\n"
+		"1\n"
+		"10.5,20.25\n"
+		"0\n"
+		"\n"
+		"PointEnd\n"
+		"LineBegin\n"
+		"LineEnd\n"
+		"PolygonBegin\n"
+		"PolygonEnd\n"
+		"AnnotationBegin\n"
+		"AnnotationEnd\n"
+		"AttributeBegin\n"
+		"WELL\n"
+		"1,north,12.5,2020-01-01\n"
+		"2,south,3,2020-01-02\n"
+		"TableEnd\n"
+		"AttributeEnd\n";
+}
+
+static void testFieldWidths()
+{
+	vct::File file;
+	const std::string written = roundTrip(SOURCE, file);
+	check(written.find("\nNAME,Char,10\n") != std::string::npos, "width of a Char field is written");
+	check(written.find("\nDEPTH,Double,10,2\n") != std::string::npos, "width and precision of a Double field are written");
+	check(written.find("\nSURVEYED,Date\n") != std::string::npos, "a field without width is written without one");
+	check(written == SOURCE, "the file is written back unchanged");
+}
+
+static void testPointWithoutGeometry()
+{
+	vct::File file;
+	roundTrip(SOURCE, file);
+
+	//a point record that lost its coordinates
+	const vct::Line code("1001", 4);
+	file.records.beginRecord(2, code, code, vct::GeometryType::Point);
+	file.records.endRecord();
+	//and a point after it
+	file.records.beginRecord(3, code, code, vct::GeometryType::Point);
+	file.records.beginPart();
+	file.records.beginRing();
+	file.records.addVertex(1, 2);
+	file.records.endRecord();
+	std::ostringstream out;
+	vct::writeFile(file, out);
+	const std::string written = out.str();
+
+	vct::File reread;
+	vct::LineReader reader(written.data(), int64_t(written.size()));
+	vct::readFile(reader, reread);
+	check(reread.records.count() == 2, "a point without coordinates is not written as a record");
+	check(reread.records.count() == 2 && reread.records.id(1) == 3 && reread.records.x(reread.records.vertexCount() - 1) == 1,
+		"the records after it stay in sync");
+	check(reread.attributeTables.size() == 1 && reread.attributeTables[0].count() == 2, "its attribute row is kept");
+	check(reread.tables.size() == 1 && reread.tables[0].fields.size() == 3, "the sections after it are read");
+}
+
+int main()
+{
+	testFieldWidths();
+	testPointWithoutGeometry();
+	if (sFailures == 0)
+		std::cout << "vctroundtrip: all tests passed" << std::endl;
+	return sFailures == 0 ? 0 : 1;
+}
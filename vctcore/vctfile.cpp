@@ -0,0 +1,455 @@
+#include "vctfile.h"
+
+#include <fstream>
+#include <iterator>
+#include <ostream>
+
+namespace
+{
+	//output is collected in blocks of this size before it is written to the stream
+	const size_t BLOCK_SIZE = 4 * 1024 * 1024;
+
+	//Fields of a line split at every comma
+	std::vector<std::string> splitFields(const vct::Line &line)
+	{
+		std::vector<std::string> fields;
+		int pos = 0;
+		vct::Line field;
+		while (line.nextField(',', pos, field))
+			fields.push_back(field.toStdString());
+		return fields;
+	}
+
+	std::string fieldValue(const std::vector<std::string> &fields, size_t index)
+	{
+		return index < fields.size() ? fields[index] : std::string();
+	}
+
+	//Sink of the attribute reader that keeps the values as text
+	class AttributeTableSink
+	{
+	public:
+		explicit AttributeTableSink(std::vector<vct::AttributeTable> &tables)
+			: mTables(tables)
+		{
+		}
+
+		void beginTable(const vct::Line &name)
+		{
+			mTables.emplace_back();
+			mTables.back().name = name.toStdString();
+		}
+
+		void addRow(int id, const vct::Line &row, int64_t, int64_t)
+		{
+			if (mTables.empty())
+				mTables.emplace_back();
+			vct::AttributeTable &table = mTables.back();
+			table.addRow(id);
+			int pos = 0;
+			vct::Line field;
+			//the first field is the feature id
+			row.nextField(',', pos, field);
+			while (row.nextField(',', pos, field))
+				table.values.push_back(field.toStdString());
+		}
+
+	private:
+		std::vector<vct::AttributeTable> &mTables;
+	};
+
+	//Buffered output of VCT text, the output of the geometry writers
+	class TextOutput
+	{
+	public:
+		explicit TextOutput(std::ostream &out)
+			: mOut(out)
+		{
+			mBuffer.reserve(BLOCK_SIZE + 64 * 1024);
+		}
+
+		void write(const char *text) { mBuffer.append(text); flushIfFull(); }
+		void write(char c) { mBuffer.push_back(c); }
+		void write(const std::string &text) { mBuffer.append(text); flushIfFull(); }
+		void writeInteger(int64_t value)
+		{
+			char text[vct::MAX_NUMBER_SIZE];
+			mBuffer.append(text, size_t(vct::formatInteger(value, text)));
+		}
+		void writeNumber(double value)
+		{
+			char text[vct::MAX_NUMBER_SIZE];
+			mBuffer.append(text, size_t(vct::formatNumber(value, text)));
+		}
+		void writeCoordinate(double x, double y)
+		{
+			writeNumber(x);
+			mBuffer.push_back(',');
+			writeNumber(y);
+			mBuffer.push_back('\n');
+			flushIfFull();
+		}
+		template <typename T>
+		void writeLine(const T &text)
+		{
+			write(text);
+			write('\n');
+		}
+		void writeIntegerLine(int64_t value)
+		{
+			writeInteger(value);
+			write('\n');
+		}
+
+		//! Writes the remaining buffer, returns false if the stream failed
+		bool finish()
+		{
+			flush();
+			mOut.flush();
+			return bool(mOut);
+		}
+
+	private:
+		void flushIfFull()
+		{
+			if (mBuffer.size() >= BLOCK_SIZE)
+				flush();
+		}
+		void flush()
+		{
+			mOut.write(mBuffer.data(), std::streamsize(mBuffer.size()));
+			mBuffer.clear();
+		}
+
+		std::ostream &mOut;
+		std::string mBuffer;
+	};
+
+	const char *geometryName(vct::GeometryType type)
+	{
+		switch (type)
+		{
+		case vct::GeometryType::Point:
+			return "Point";
+		case vct::GeometryType::Line:
+			return "Line";
+		case vct::GeometryType::Polygon:
+			return "Polygon";
+		default:
+			return nullptr;
+		}
+	}
+
+	void writeRecords(TextOutput &output, const vct::Records &records, vct::GeometryType type)
+	{
+		for (int row = 0; row < records.count(); row++)
+		{
+			if (records.geometryType(row) != type)
+				continue;
+			if (type == vct::GeometryType::Point && vct::recordVertexCount(records, row) == 0)
+				continue;
+			output.writeIntegerLine(records.id(row));
+			output.writeLine(records.featureCode(row));
+			output.writeLine(records.graphicCode(row));
+			switch (type)
+			{
+			case vct::GeometryType::Point:
+				vct::writePointGeometry(output, records, row);
+				break;
+			case vct::GeometryType::Line:
+				vct::writeLineGeometry(output, records, row);
+				break;
+			case vct::GeometryType::Polygon:
+				vct::writePolygonGeometry(output, records, row);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+namespace vct
+{
+	void Records::beginRecord(int id, const Line &featureCode, const Line &graphicCode, GeometryType type, int64_t)
+	{
+		mIds.push_back(id);
+		mGeometryTypes.push_back(type);
+		mFeatureCodes.push_back(featureCode.trimmed().toStdString());
+		mGraphicCodes.push_back(graphicCode.trimmed().toStdString());
+		mFeaturePartBegin.push_back(int(mPartRingBegin.size()));
+		mFeaturePartCount.push_back(0);
+	}
+
+	void Records::beginPart()
+	{
+		mPartRingBegin.push_back(int(mRingVertexBegin.size()));
+		mPartRingCount.push_back(0);
+		++mFeaturePartCount.back();
+	}
+
+	void Records::beginRing()
+	{
+		mRingVertexBegin.push_back(int(mX.size()));
+		mRingVertexCount.push_back(0);
+		++mPartRingCount.back();
+	}
+
+	void Records::endRecord(int64_t)
+	{
+	}
+
+	void AttributeTable::addRow(int64_t id)
+	{
+		ids.push_back(id);
+		rowBegin.push_back(values.size());
+	}
+
+	std::string readComment(LineReader &reader)
+	{
+		std::string comment;
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != Marker::CommentEnd)
+		{
+			comment.append(line.data(), size_t(line.size()));
+			line = reader.readLine();
+		}
+		return comment;
+	}
+
+	void readHead(LineReader &reader, std::vector<std::string> &head)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != Marker::HeadEnd)
+		{
+			head.push_back(line.toStdString());
+			line = reader.readLine();
+		}
+	}
+
+	void readFeatureCodes(LineReader &reader, std::vector<FeatureClass> &classes, std::vector<std::string> &customItems)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != Marker::FeatureCodeEnd)
+		{
+			const std::vector<std::string> values = splitFields(line);
+			FeatureClass featureClass;
+			featureClass.code = fieldValue(values, 0);
+			featureClass.name = fieldValue(values, 1);
+			const std::string geometry = fieldValue(values, 2);
+			featureClass.table = fieldValue(values, 3);
+			if (geometry.find("Point") != std::string::npos)
+				featureClass.geometryType = GeometryType::Point;
+			else if (geometry.find("Line") != std::string::npos)
+				featureClass.geometryType = GeometryType::Line;
+			else if (geometry.find("Polygon") != std::string::npos)
+				featureClass.geometryType = GeometryType::Polygon;
+
+			if (featureClass.geometryType != GeometryType::None)
+				classes.push_back(featureClass);
+			else if (!line.trimmed().isEmpty())
+				customItems.push_back(line.toStdString());
+			line = reader.readLine();
+		}
+	}
+
+	void readTableStructures(LineReader &reader, std::vector<TableStructure> &tables)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != Marker::TableStructureEnd)
+		{
+			const std::vector<std::string> values = splitFields(line);
+			if (values.size() < 2)
+			{
+				//the "0" line closing a table
+				line = reader.readLine();
+				continue;
+			}
+			int pos = 0;
+			Line field;
+			line.nextField(',', pos, field);
+			line.nextField(',', pos, field);
+			const int fieldCount = field.toInt();
+
+			TableStructure table;
+			table.name = Line(values[0].data(), int(values[0].size())).trimmed().toStdString();
+			for (int i = 0; i < fieldCount && !reader.atEnd(); i++)
+			{
+				const Line fieldLine = reader.readLine();
+				const std::vector<std::string> extra = splitFields(fieldLine);
+				Field tableField;
+				tableField.name = fieldValue(extra, 0);
+				tableField.type = fieldValue(extra, 1);
+				if (extra.size() >= 3)
+					tableField.length = Line(extra[2].data(), int(extra[2].size())).toInt();
+				if (extra.size() == 4)
+					tableField.precision = Line(extra[3].data(), int(extra[3].size())).toInt();
+				table.fields.push_back(tableField);
+			}
+			tables.push_back(table);
+			line = reader.readLine();
+		}
+	}
+
+	void readFile(LineReader &reader, File &file)
+	{
+		AttributeTableSink attributes(file.attributeTables);
+		for (Line line = reader.readLine(); !line.isNull(); line = reader.readLine())
+		{
+			const Marker section = marker(line);
+			switch (section)
+			{
+			case Marker::CommentBegin:
+				file.comments.push_back(readComment(reader));
+				break;
+			case Marker::HeadBegin:
+				readHead(reader, file.head);
+				break;
+			case Marker::FeatureCodeBegin:
+				readFeatureCodes(reader, file.featureClasses, file.customItems);
+				break;
+			case Marker::TableStructureBegin:
+				readTableStructures(reader, file.tables);
+				break;
+			case Marker::PointBegin:
+				readPoints(reader, file.records);
+				break;
+			case Marker::LineBegin:
+				readLines(reader, file.records);
+				break;
+			case Marker::PolygonBegin:
+				readPolygons(reader, file.records);
+				break;
+			case Marker::AttributeBegin:
+				readAttributeRows(reader, true, attributes);
+				break;
+			case Marker::SolidBegin:
+			case Marker::AggregationBegin:
+			case Marker::AnnotationBegin:
+			case Marker::TopologyBegin:
+			case Marker::StyleBegin:
+				skipSection(reader, endMarker(section));
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	bool readFile(const std::string &path, File &file, std::string &error)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+		{
+			error = "Could not open VCT file " + path;
+			return false;
+		}
+		const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		if (in.bad())
+		{
+			error = "Could not read VCT file " + path;
+			return false;
+		}
+		LineReader reader(text.data(), int64_t(text.size()));
+		readFile(reader, file);
+		return true;
+	}
+
+	bool writeFile(const File &file, std::ostream &out)
+	{
+		TextOutput output(out);
+
+		for (const std::string &comment : file.comments)
+		{
+			output.writeLine("CommentBegin");
+			output.writeLine(comment);
+			output.writeLine("CommentEnd");
+		}
+
+		output.writeLine("HeadBegin");
+		for (const std::string &head : file.head)
+			output.writeLine(head);
+		output.writeLine("HeadEnd");
+
+		output.writeLine("FeatureCodeBegin");
+		for (const FeatureClass &featureClass : file.featureClasses)
+		{
+			const char *geometry = geometryName(featureClass.geometryType);
+			if (!geometry)
+				continue;
+			output.write(featureClass.code);
+			output.write(',');
+			output.write(featureClass.name);
+			output.write(',');
+			output.write(geometry);
+			output.write(',');
+			output.writeLine(featureClass.table);
+		}
+		for (const std::string &item : file.customItems)
+			output.writeLine(item);
+		output.writeLine("FeatureCodeEnd");
+
+		output.writeLine("TableStructureBegin");
+		for (const TableStructure &table : file.tables)
+		{
+			output.write(table.name);
+			output.write(',');
+			output.writeIntegerLine(int64_t(table.fields.size()));
+			for (const Field &field : table.fields)
+			{
+				output.write(field.name);
+				output.write(',');
+				output.write(field.type);
+				//the width is kept for every type that declares one, the precision of floating point fields
+				if (field.type == "Double")
+				{
+					output.write(',');
+					output.writeInteger(field.length);
+					output.write(',');
+					output.writeInteger(field.precision);
+				}
+				else if (field.length > 0)
+				{
+					output.write(',');
+					output.writeInteger(field.length);
+				}
+				output.write('\n');
+			}
+			output.writeLine("0");
+		}
+		output.writeLine("TableStructureEnd");
+
+		//the records of all classes of a geometry type share one section
+		output.writeLine("PointBegin");
+		writeRecords(output, file.records, GeometryType::Point);
+		output.writeLine("PointEnd");
+		output.writeLine("LineBegin");
+		writeRecords(output, file.records, GeometryType::Line);
+		output.writeLine("LineEnd");
+		output.writeLine("PolygonBegin");
+		writeRecords(output, file.records, GeometryType::Polygon);
+		output.writeLine("PolygonEnd");
+		output.writeLine("AnnotationBegin");
+		output.writeLine("AnnotationEnd");
+
+		output.writeLine("AttributeBegin");
+		for (const AttributeTable &table : file.attributeTables)
+		{
+			output.writeLine(table.name);
+			for (int row = 0; row < table.count(); row++)
+			{
+				output.writeInteger(table.ids[size_t(row)]);
+				for (int i = 0; i < table.valueCount(row); i++)
+				{
+					output.write(',');
+					output.write(table.value(row, i));
+				}
+				output.write('\n');
+			}
+			output.writeLine("TableEnd");
+		}
+		output.writeLine("AttributeEnd");
+
+		return output.finish();
+	}
+}
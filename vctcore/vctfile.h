@@ -0,0 +1,137 @@
+#pragma once
+
+#include "vctline.h"
+#include "vctrecords.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace vct
+{
+	//! Feature class declared in the feature code section
+	struct FeatureClass
+	{
+		std::string code;
+		std::string name;
+		GeometryType geometryType = GeometryType::None;
+		std::string table;
+	};
+
+	//! Field of an attribute table, with the type name as declared in the file
+	struct Field
+	{
+		std::string name;
+		std::string type;
+		int length = 0;
+		int precision = 0;
+	};
+
+	struct TableStructure
+	{
+		std::string name;
+		std::vector<Field> fields;
+	};
+
+	/**
+	 * Records of the point, line and polygon sections in flat buffers: a record references a range of
+	 * parts, a part a range of rings and a ring a range of vertices. Records are the sink of the record
+	 * readers and the store of the geometry writers, and are built the same way in memory.
+	 */
+	class Records
+	{
+	public:
+
+		int count() const { return int(mIds.size()); }
+		int64_t id(int row) const { return mIds[size_t(row)]; }
+		GeometryType geometryType(int row) const { return mGeometryTypes[size_t(row)]; }
+		const std::string &featureCode(int row) const { return mFeatureCodes[size_t(row)]; }
+		const std::string &graphicCode(int row) const { return mGraphicCodes[size_t(row)]; }
+
+		int featurePartBegin(int row) const { return mFeaturePartBegin[size_t(row)]; }
+		int featurePartCount(int row) const { return mFeaturePartCount[size_t(row)]; }
+		int partRingBegin(int part) const { return mPartRingBegin[size_t(part)]; }
+		int partRingCount(int part) const { return mPartRingCount[size_t(part)]; }
+		int ringVertexBegin(int ring) const { return mRingVertexBegin[size_t(ring)]; }
+		int ringVertexCount(int ring) const { return mRingVertexCount[size_t(ring)]; }
+		int vertexCount() const { return int(mX.size()); }
+		double x(int vertex) const { return mX[size_t(vertex)]; }
+		double y(int vertex) const { return mY[size_t(vertex)]; }
+
+		void beginRecord(int id, const Line &featureCode, const Line &graphicCode, GeometryType type, int64_t recordBegin = -1);
+		void beginPart();
+		void beginRing();
+		void addVertex(double x, double y)
+		{
+			mX.push_back(x);
+			mY.push_back(y);
+			++mRingVertexCount.back();
+		}
+		void endRecord(int64_t recordEnd = -1);
+
+	private:
+		std::vector<int64_t> mIds;
+		std::vector<GeometryType> mGeometryTypes;
+		std::vector<std::string> mFeatureCodes;
+		std::vector<std::string> mGraphicCodes;
+		std::vector<int> mFeaturePartBegin;
+		std::vector<int> mFeaturePartCount;
+		std::vector<int> mPartRingBegin;
+		std::vector<int> mPartRingCount;
+		std::vector<int> mRingVertexBegin;
+		std::vector<int> mRingVertexCount;
+		std::vector<double> mX;
+		std::vector<double> mY;
+	};
+
+	//! Rows of an attribute table with their values as text, in file order
+	struct AttributeTable
+	{
+		std::string name;
+		std::vector<int64_t> ids;
+		//first value of each row, the values of a row end at the first value of the next one
+		std::vector<size_t> rowBegin;
+		std::vector<std::string> values;
+
+		int count() const { return int(ids.size()); }
+		int valueCount(int row) const { return int(rowEnd(row) - rowBegin[size_t(row)]); }
+		const std::string &value(int row, int index) const { return values[rowBegin[size_t(row)] + size_t(index)]; }
+		//! Appends a row of \a id, add its values afterwards
+		void addRow(int64_t id);
+
+	private:
+		size_t rowEnd(int row) const { return size_t(row) + 1 < rowBegin.size() ? rowBegin[size_t(row) + 1] : values.size(); }
+	};
+
+	//! Content of a VCT file
+	struct File
+	{
+		std::vector<std::string> comments;
+		std::vector<std::string> head;
+		std::vector<FeatureClass> featureClasses;
+		//lines of the feature code section that do not declare a point, line or polygon class
+		std::vector<std::string> customItems;
+		std::vector<TableStructure> tables;
+		Records records;
+		std::vector<AttributeTable> attributeTables;
+	};
+
+	//! Parses VCT text
+	void readFile(LineReader &reader, File &file);
+	//! Reads the VCT file at \a path, returns false and sets \a error when it can not be read
+	bool readFile(const std::string &path, File &file, std::string &error);
+	/**
+	 * Writes \a file as VCT text, returns false when \a out fails. Records are written in the section
+	 * of their geometry type, in their order.
+	 */
+	bool writeFile(const File &file, std::ostream &out);
+
+	/**
+	 * Readers of the sections that describe the file, each reads up to and including the end marker
+	 * of its section.
+	 */
+	std::string readComment(LineReader &reader);
+	void readHead(LineReader &reader, std::vector<std::string> &head);
+	void readFeatureCodes(LineReader &reader, std::vector<FeatureClass> &classes, std::vector<std::string> &customItems);
+	void readTableStructures(LineReader &reader, std::vector<TableStructure> &tables);
+}
@@ -0,0 +1,208 @@
+#include "vctline.h"
+#include "vctnumbers.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	struct SectionStem
+	{
+		const char *stem;
+		int size;
+		vct::Marker begin;
+		vct::Marker end;
+	};
+
+	const SectionStem SECTION_STEMS[] =
+	{
+		{ "Comment", 7, vct::Marker::CommentBegin, vct::Marker::CommentEnd },
+		{ "Head", 4, vct::Marker::HeadBegin, vct::Marker::HeadEnd },
+		{ "FeatureCode", 11, vct::Marker::FeatureCodeBegin, vct::Marker::FeatureCodeEnd },
+		{ "TableStructure", 14, vct::Marker::TableStructureBegin, vct::Marker::TableStructureEnd },
+		{ "Point", 5, vct::Marker::PointBegin, vct::Marker::PointEnd },
+		{ "Line", 4, vct::Marker::LineBegin, vct::Marker::LineEnd },
+		{ "Polygon", 7, vct::Marker::PolygonBegin, vct::Marker::PolygonEnd },
+		{ "Solid", 5, vct::Marker::SolidBegin, vct::Marker::SolidEnd },
+		{ "Aggregation", 11, vct::Marker::AggregationBegin, vct::Marker::AggregationEnd },
+		{ "Annotation", 10, vct::Marker::AnnotationBegin, vct::Marker::AnnotationEnd },
+		{ "Topology", 8, vct::Marker::TopologyBegin, vct::Marker::TopologyEnd },
+		{ "Attribute", 9, vct::Marker::AttributeBegin, vct::Marker::AttributeEnd },
+		{ "Style", 5, vct::Marker::StyleBegin, vct::Marker::StyleEnd },
+		{ "Table", 5, vct::Marker::None, vct::Marker::TableEnd },
+	};
+
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+	}
+}
+
+namespace vct
+{
+	Line Line::trimmed() const
+	{
+		const char *begin = mData;
+		const char *end = mData + mSize;
+		while (begin < end && isBlank(*begin))
+			++begin;
+		while (end > begin && isBlank(end[-1]))
+			--end;
+		return Line(begin, int(end - begin));
+	}
+
+	bool Line::equals(const char *literal) const
+	{
+		const Line word = trimmed();
+		const size_t length = strlen(literal);
+		return size_t(word.mSize) == length && memcmp(word.mData, literal, length) == 0;
+	}
+
+	int Line::toInt(bool *ok) const
+	{
+		const Line word = trimmed();
+		const char *p = word.mData;
+		const char *end = p + word.mSize;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+		if (p == end)
+		{
+			if (ok)
+				*ok = false;
+			return 0;
+		}
+		int64_t value = 0;
+		for (; p < end; ++p)
+		{
+			const unsigned digit = unsigned(*p - '0');
+			if (digit > 9 || value > std::numeric_limits<int>::max())
+			{
+				if (ok)
+					*ok = false;
+				return 0;
+			}
+			value = value * 10 + digit;
+		}
+		if (negative)
+			value = -value;
+		if (value > std::numeric_limits<int>::max() || value < std::numeric_limits<int>::min())
+		{
+			if (ok)
+				*ok = false;
+			return 0;
+		}
+		if (ok)
+			*ok = true;
+		return int(value);
+	}
+
+	double Line::toDouble(bool *ok) const
+	{
+		double value;
+		const bool parsed = parseDouble(mData, mData + mSize, value);
+		if (ok)
+			*ok = parsed;
+		return value;
+	}
+
+	bool Line::nextField(char sep, int &pos, Line &field) const
+	{
+		if (pos > mSize)
+			return false;
+		const char *start = mData + pos;
+		const char *stop = static_cast<const char *>(memchr(start, sep, size_t(mSize - pos)));
+		if (!stop)
+			stop = mData + mSize;
+		field = Line(start, int(stop - start));
+		pos = int(stop - mData) + 1;
+		return true;
+	}
+
+	LineReader::LineReader(const char *data, int64_t size)
+		: mBegin(data)
+		, mEnd(data + size)
+		, mPos(data)
+	{
+		//skip the UTF-8 byte order mark
+		if (mEnd - mPos >= 3 && memcmp(mPos, "\xEF\xBB\xBF", 3) == 0)
+			mPos += 3;
+	}
+
+	LineReader::LineReader(const LineReader &source, int64_t begin, int64_t end)
+		: mBegin(source.mBegin)
+		, mEnd(source.mBegin + std::min(std::max<int64_t>(0, end), source.size()))
+		, mPos(source.mBegin + std::min(std::max<int64_t>(0, begin), source.size()))
+	{
+	}
+
+	void LineReader::seek(int64_t offset)
+	{
+		mPos = mBegin + std::min(std::max<int64_t>(0, offset), int64_t(mEnd - mBegin));
+	}
+
+	Marker marker(const Line &line)
+	{
+		const Line word = line.trimmed();
+		const char *data = word.data();
+		const int size = word.size();
+
+		//coordinates, counts and attribute rows are rejected on the last character
+		if (size < 7 || (data[size - 1] != 'n' && data[size - 1] != 'd'))
+			return Marker::None;
+
+		bool begin;
+		int stemSize;
+		if (memcmp(data + size - 5, "Begin", 5) == 0)
+		{
+			begin = true;
+			stemSize = size - 5;
+		}
+		else if (memcmp(data + size - 3, "End", 3) == 0)
+		{
+			begin = false;
+			stemSize = size - 3;
+		}
+		else
+			return Marker::None;
+
+		for (const SectionStem &stem : SECTION_STEMS)
+		{
+			if (stem.size == stemSize && stem.stem[0] == data[0] && memcmp(stem.stem, data, size_t(stemSize)) == 0)
+				return begin ? stem.begin : stem.end;
+		}
+		return Marker::None;
+	}
+
+	Marker endMarker(Marker begin)
+	{
+		if (begin == Marker::None)
+			return Marker::None;
+		for (const SectionStem &stem : SECTION_STEMS)
+		{
+			if (stem.begin == begin)
+				return stem.end;
+		}
+		return Marker::None;
+	}
+
+	void skipSection(LineReader &reader, Marker end)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != end)
+		{
+			line = reader.readLine();
+		}
+	}
+
+	Line readNextRecord(LineReader &reader)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && line.trimmed().isEmpty())
+			line = reader.readLine();
+		return line;
+	}
+}
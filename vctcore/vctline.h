@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Core of the VCT reader and writer. The vct namespace only depends on the standard library, so the
+ * parser can be benchmarked, fuzzed and embedded in batch pipelines without QGIS or Qt. The provider
+ * wraps it: its tokenizer maps the file and hands the bytes to a LineReader, its dataset reads the
+ * sections with the readers of vctfile.h and vctrecords.h into its feature stores.
+ */
+namespace vct
+{
+	//Section markers of a VCT file
+	enum class Marker
+	{
+		None,
+		CommentBegin, CommentEnd,
+		HeadBegin, HeadEnd,
+		FeatureCodeBegin, FeatureCodeEnd,
+		TableStructureBegin, TableStructureEnd,
+		PointBegin, PointEnd,
+		LineBegin, LineEnd,
+		PolygonBegin, PolygonEnd,
+		SolidBegin, SolidEnd,
+		AggregationBegin, AggregationEnd,
+		AnnotationBegin, AnnotationEnd,
+		TopologyBegin, TopologyEnd,
+		AttributeBegin, AttributeEnd,
+		StyleBegin, StyleEnd,
+		TableEnd
+	};
+
+	/**
+	 * One line of VCT text, viewed in place.
+	 * The view does not own its bytes and stays valid as long as the text does.
+	 */
+	class Line
+	{
+	public:
+		Line() = default;
+		Line(const char *data, int size) : mData(data), mSize(size) {}
+
+		const char *data() const { return mData; }
+		int size() const { return mSize; }
+		//! True past the end of the text
+		bool isNull() const { return mData == nullptr; }
+		bool isEmpty() const { return mSize == 0; }
+		bool contains(char c) const { return mSize > 0 && memchr(mData, c, size_t(mSize)) != nullptr; }
+
+		//! Returns the line without leading and trailing blanks
+		Line trimmed() const;
+		//! Compares the trimmed line with a literal
+		bool equals(const char *literal) const;
+
+		//! Integer value of the line, 0 if it is not a number
+		int toInt(bool *ok = nullptr) const;
+		//! Locale independent floating point value of the line
+		double toDouble(bool *ok = nullptr) const;
+		std::string toStdString() const { return mData ? std::string(mData, size_t(mSize)) : std::string(); }
+
+		/**
+		 * Reads the field starting at \a pos up to the next \a sep and moves \a pos past it.
+		 * Yields the same fields as splitting at every \a sep, returns false when none is left.
+		 */
+		bool nextField(char sep, int &pos, Line &field) const;
+
+	private:
+		const char *mData = nullptr;
+		int mSize = 0;
+	};
+
+	/**
+	 * Splits VCT text into lines without copying it. The text is owned by the caller, for example
+	 * a memory mapping of the file.
+	 */
+	class LineReader
+	{
+	public:
+		LineReader() = default;
+		//! Reads the \a size bytes at \a data, after a UTF-8 byte order mark
+		LineReader(const char *data, int64_t size);
+		//! Reads the byte range [begin, end) of the text of \a source, offsets stay relative to the whole text
+		LineReader(const LineReader &source, int64_t begin, int64_t end);
+
+		bool atEnd() const { return mPos >= mEnd; }
+		//! Byte offset of the next line
+		int64_t pos() const { return mPos - mBegin; }
+		void seek(int64_t offset);
+		int64_t size() const { return mEnd - mBegin; }
+		const char *data() const { return mBegin; }
+
+		//! Returns the next line without its terminator, a null line past the end
+		inline Line readLine();
+		//! Number of lines returned by readLine()
+		int64_t lineCount() const { return mLineCount; }
+
+	private:
+		const char *mBegin = nullptr;
+		const char *mEnd = nullptr;
+		const char *mPos = nullptr;
+		int64_t mLineCount = 0;
+	};
+
+	//! Classifies a line as a section marker
+	Marker marker(const Line &line);
+	//! Returns the end marker matching a begin marker, None for other markers
+	Marker endMarker(Marker begin);
+	//! Reads up to and including the \a end marker
+	void skipSection(LineReader &reader, Marker end);
+	//! Reads the line after a record terminator, skipping the blank separator lines
+	Line readNextRecord(LineReader &reader);
+
+	inline Line LineReader::readLine()
+	{
+		if (mPos >= mEnd)
+			return Line();
+		++mLineCount;
+		const char *start = mPos;
+		const char *stop = static_cast<const char *>(memchr(start, '\n', size_t(mEnd - start)));
+		if (stop)
+			mPos = stop + 1;
+		else
+			mPos = stop = mEnd;
+		if (stop > start && stop[-1] == '\r')
+			--stop;
+		return Line(start, int(stop - start));
+	}
+}
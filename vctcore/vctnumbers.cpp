@@ -0,0 +1,317 @@
+#include "vctnumbers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __has_include
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+//floating point from_chars and to_chars, libraries that only convert integers leave this undefined
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define VCT_HAVE_FLOAT_CHARCONV
+#else
+#include <cerrno>
+#include <clocale>
+#include <cstdio>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#endif
+
+namespace
+{
+	//powers of ten that are exact in a double
+	const double POWERS_OF_TEN[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const int MAX_FAST_DECIMALS = 15;
+
+	//largest integer below which every integer is exact in a double
+	const uint64_t MAX_EXACT_MANTISSA = uint64_t(1) << 53;
+
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline unsigned digitValue(char c)
+	{
+		return unsigned(c - '0');
+	}
+
+#ifndef VCT_HAVE_FLOAT_CHARCONV
+#ifdef _MSC_VER
+	typedef _locale_t CLocale;
+#else
+	typedef locale_t CLocale;
+#endif
+
+	//The "C" locale, whose decimal point is a dot whatever the process locale is
+	CLocale classicLocale()
+	{
+#ifdef _MSC_VER
+		static const CLocale locale = _create_locale(LC_ALL, "C");
+#else
+		static const CLocale locale = newlocale(LC_ALL_MASK, "C", CLocale(0));
+#endif
+		return locale;
+	}
+#endif
+
+	/**
+	 * Parses with the correctly rounded conversion of the library, for the numbers the fast path can
+	 * not handle. Neither conversion allocates nor depends on the process locale.
+	 */
+	bool parseDoubleSlow(const char *begin, const char *end, double &value)
+	{
+		const char *p = begin;
+		if (p < end && (*p == '-' || *p == '+'))
+			++p;
+		//the library would also read the names of infinity and NaN, and strtod hexadecimal numbers
+		const bool ok = p < end && (digitValue(*p) <= 9 || *p == '.') && !(p + 1 < end && (p[1] == 'x' || p[1] == 'X'));
+		if (ok)
+		{
+#ifdef VCT_HAVE_FLOAT_CHARCONV
+			//from_chars takes the minus sign only
+			const std::from_chars_result result = std::from_chars(*begin == '+' ? begin + 1 : begin, end, value);
+			if (result.ec == std::errc() && result.ptr == end)
+				return true;
+#else
+			//strtod needs a terminated copy, longer texts can not be numbers of VCT
+			char text[vct::MAX_NUMBER_SIZE * 2];
+			const size_t size = size_t(end - begin);
+			if (size < sizeof(text))
+			{
+				memcpy(text, begin, size);
+				text[size] = 0;
+				char *stop = nullptr;
+				errno = 0;
+#ifdef _MSC_VER
+				value = _strtod_l(text, &stop, classicLocale());
+#else
+				value = strtod_l(text, &stop, classicLocale());
+#endif
+				//out of range like from_chars
+				if (stop == text + size && errno != ERANGE)
+					return true;
+			}
+#endif
+		}
+		value = 0;
+		return false;
+	}
+
+	//Writes the digits of value backwards from end, returns the first digit
+	inline char *formatDigits(uint64_t value, char *end)
+	{
+		char *p = end;
+		do
+		{
+			*--p = char('0' + value % 10);
+			value /= 10;
+		} while (value);
+		return p;
+	}
+}
+
+namespace vct
+{
+	bool parseDouble(const char *begin, const char *end, double &value)
+	{
+		while (begin < end && isBlank(*begin))
+			++begin;
+		while (end > begin && isBlank(end[-1]))
+			--end;
+		if (begin == end)
+		{
+			value = 0;
+			return false;
+		}
+
+		const char *p = begin;
+		bool negative = false;
+		if (*p == '-' || *p == '+')
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		//significant digits go to the mantissa, the decimal point and dropped digits to the exponent
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool anyDigit = false;
+		bool truncated = false;
+		for (; p < end && digitValue(*p) <= 9; ++p)
+		{
+			anyDigit = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + digitValue(*p);
+				if (mantissa)
+					++digits;
+			}
+			else
+			{
+				++exponent;
+				truncated |= *p != '0';
+			}
+		}
+		if (p < end && *p == '.')
+		{
+			++p;
+			for (; p < end && digitValue(*p) <= 9; ++p)
+			{
+				anyDigit = true;
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + digitValue(*p);
+					if (mantissa)
+						++digits;
+					--exponent;
+				}
+				else
+					truncated |= *p != '0';
+			}
+		}
+		if (!anyDigit)
+			return parseDoubleSlow(begin, end, value);
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				++p;
+			}
+			if (p == end || digitValue(*p) > 9)
+				return parseDoubleSlow(begin, end, value);
+			int explicitExponent = 0;
+			for (; p < end && digitValue(*p) <= 9; ++p)
+			{
+				if (explicitExponent < 100000)
+					explicitExponent = explicitExponent * 10 + int(digitValue(*p));
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+		}
+		if (p != end)
+			return parseDoubleSlow(begin, end, value);
+
+		//Clinger's fast path: an exact mantissa times an exact power of ten rounds correctly
+		if (!truncated && mantissa <= MAX_EXACT_MANTISSA && exponent >= -22 && exponent <= 22)
+		{
+			double result = double(mantissa);
+			if (exponent < 0)
+				result /= POWERS_OF_TEN[-exponent];
+			else
+				result *= POWERS_OF_TEN[exponent];
+			value = negative ? -result : result;
+			return true;
+		}
+		return parseDoubleSlow(begin, end, value);
+	}
+
+	int parseCoordinate(const char *begin, const char *end, double *xyz)
+	{
+		xyz[0] = xyz[1] = xyz[2] = 0;
+		int count = 0;
+		const char *p = begin;
+		while (count < 3)
+		{
+			const char *stop = findDelimiter(p, end, ',');
+			parseDouble(p, stop, xyz[count]);
+			++count;
+			if (stop == end)
+				break;
+			p = stop + 1;
+		}
+		return count;
+	}
+
+	int formatInteger(int64_t value, char *text)
+	{
+		char digits[24];
+		char *end = digits + sizeof(digits);
+		const uint64_t magnitude = value < 0 ? uint64_t(0) - uint64_t(value) : uint64_t(value);
+		char *begin = formatDigits(magnitude, end);
+		if (value < 0)
+			*--begin = '-';
+		const int size = int(end - begin);
+		memcpy(text, begin, size_t(size));
+		return size;
+	}
+
+	int formatNumber(double value, char *text)
+	{
+		const double magnitude = std::fabs(value);
+		if (magnitude < double(MAX_EXACT_MANTISSA))
+		{
+			//the fewest decimals whose integer mantissa divided by the exact power of ten gives the value
+			//back; readers round that quotient correctly, so the text reads back to the same double
+			for (int decimals = 0; decimals <= MAX_FAST_DECIMALS; decimals++)
+			{
+				const double scaled = magnitude * POWERS_OF_TEN[decimals];
+				if (scaled >= double(MAX_EXACT_MANTISSA))
+					break;
+				const uint64_t mantissa = uint64_t(std::floor(scaled + 0.5));
+				if (double(mantissa) / POWERS_OF_TEN[decimals] != magnitude)
+					continue;
+
+				char digits[MAX_NUMBER_SIZE];
+				char *end = digits + sizeof(digits);
+				char *begin = formatDigits(mantissa, end);
+				if (decimals > 0)
+				{
+					//move the integer digits in front of the decimal point, padding with zeros
+					int fraction = int(end - begin);
+					while (fraction < decimals + 1)
+					{
+						*--begin = '0';
+						fraction++;
+					}
+					char *point = end - decimals;
+					memmove(begin - 1, begin, size_t(point - begin));
+					--begin;
+					point[-1] = '.';
+				}
+				if (value < 0 && mantissa != 0)
+					*--begin = '-';
+				const int size = int(end - begin);
+				memcpy(text, begin, size_t(size));
+				return size;
+			}
+		}
+
+#ifdef VCT_HAVE_FLOAT_CHARCONV
+		//to_chars writes the shortest text that reads back to the same value
+		return int(std::to_chars(text, text + MAX_NUMBER_SIZE, value).ptr - text);
+#else
+		//the shortest precision that reads back to the same value, printed with the decimal point of
+		//the "C" locale: the digits are the same in every locale, only the decimal point is replaced
+		int size = 0;
+		for (int precision = 15; precision <= 17; precision++)
+		{
+			size = snprintf(text, size_t(MAX_NUMBER_SIZE), "%.*g", precision, value);
+			size = std::min(std::max(size, 0), MAX_NUMBER_SIZE - 1);
+			for (int i = 0; i < size; i++)
+			{
+				const bool letter = (text[i] | 0x20) >= 'a' && (text[i] | 0x20) <= 'z';
+				if (text[i] != '-' && text[i] != '+' && !letter && digitValue(text[i]) > 9)
+					text[i] = '.';
+			}
+			double parsed;
+			if (parseDouble(text, text + size, parsed) && parsed == value)
+				break;
+		}
+		return size;
+#endif
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VCT_HAVE_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+ * Non-allocating, locale independent conversion of the numbers of VCT text.
+ *
+ * Parsing is correctly rounded: numbers with up to 15 significant digits and a small decimal
+ * exponent are converted exactly, anything else goes through std::from_chars, or strtod_l in the
+ * "C" locale where the library has no floating point from_chars. Formatting writes doubles in their shortest form that reads back to the
+ * same value.
+ */
+namespace vct
+{
+	/**
+	 * Parses the number in [begin, end), surrounding blanks allowed.
+	 * \a value is 0 and false is returned when the text is not a number.
+	 */
+	bool parseDouble(const char *begin, const char *end, double &value);
+
+	/**
+	 * Parses the comma separated ordinates of a coordinate line "x,y[,z]" into \a xyz.
+	 * Missing or invalid ordinates are set to 0, returns the number of fields read (at most 3).
+	 */
+	int parseCoordinate(const char *begin, const char *end, double *xyz);
+
+	//! Returns the first \a delimiter in [begin, end), or \a end
+	inline const char *findDelimiter(const char *begin, const char *end, char delimiter);
+
+	//! Size of a buffer that holds the text of any number written by formatInteger() and formatNumber()
+	const int MAX_NUMBER_SIZE = 48;
+	//! Writes the decimal text of \a value to \a text and returns its length, without a terminating zero
+	int formatInteger(int64_t value, char *text);
+	int formatNumber(double value, char *text);
+
+	inline int countTrailingZeroBits(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return int(index);
+#else
+		return __builtin_ctz(value);
+#endif
+	}
+
+	inline const char *findDelimiter(const char *begin, const char *end, char delimiter)
+	{
+		const char *p = begin;
+#ifdef VCT_HAVE_SSE2
+		const __m128i needle = _mm_set1_epi8(delimiter);
+		while (end - p >= 16)
+		{
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+			const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+			if (mask)
+				return p + countTrailingZeroBits(uint32_t(mask));
+			p += 16;
+		}
+#endif
+		for (; p < end; ++p)
+		{
+			if (*p == delimiter)
+				return p;
+		}
+		return end;
+	}
+}
@@ -0,0 +1,353 @@
+#pragma once
+
+#include "vctline.h"
+#include "vctnumbers.h"
+
+/**
+ * Readers and writers of the records of the point, line, polygon and attribute sections.
+ *
+ * They are templates over the storage of the records, so the hot loops call the storage without
+ * indirection. A record sink has the members
+ *
+ *   void beginRecord(int id, const Line &featureCode, const Line &graphicCode, GeometryType type, int64_t recordBegin);
+ *   void beginPart();
+ *   void beginRing();
+ *   void addVertex(double x, double y);
+ *   void endRecord(int64_t recordEnd);
+ *
+ * where the record offsets are relative to the data of the LineReader. A record store for the
+ * writers has the members featurePartBegin(row), featurePartCount(row), partRingBegin(part),
+ * partRingCount(part), ringVertexBegin(ring), ringVertexCount(ring), x(vertex) and y(vertex).
+ */
+namespace vct
+{
+	enum class GeometryType
+	{
+		None,
+		Point,
+		Line,
+		Polygon,
+	};
+
+	template <class Sink>
+	inline void readVertex(const Line &line, Sink &sink)
+	{
+		double xyz[3];
+		parseCoordinate(line.data(), line.data() + line.size(), xyz);
+		sink.addVertex(xyz[0], xyz[1]);
+	}
+
+	//! Reads the records of a point section up to and including its end marker
+	template <class Sink>
+	void readPoints(LineReader &reader, Sink &sink)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != Marker::PointEnd)
+		{
+			const int64_t recordBegin = line.data() - reader.data();
+			const int id = line.toInt();
+			const Line featureCode = reader.readLine();
+			const Line graphicCode = reader.readLine();
+			const int featureType = reader.readLine().toInt();
+			sink.beginRecord(id, featureCode, graphicCode, GeometryType::Point, recordBegin);
+			if (featureType != 4)
+			{
+				//独立点、结点、有向点
+				sink.beginPart();
+				sink.beginRing();
+				readVertex(reader.readLine(), sink);
+			}
+			else
+			{
+				//点簇
+				const int count = reader.readLine().toInt();
+				for (int i = 0; i < count; i++)
+				{
+					sink.beginPart();
+					sink.beginRing();
+					readVertex(reader.readLine(), sink);
+				}
+			}
+			sink.endRecord(reader.pos());
+			line = reader.readLine();
+			if (line.equals("0"))
+				line = readNextRecord(reader);
+		}
+	}
+
+	//! Reads the records of a line section up to and including its end marker
+	template <class Sink>
+	void readLines(LineReader &reader, Sink &sink)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != Marker::LineEnd)
+		{
+			const int64_t recordBegin = line.data() - reader.data();
+			const int id = line.toInt();
+			const Line featureCode = reader.readLine();
+			const Line graphicCode = reader.readLine();
+			const int featureType = reader.readLine().toInt();
+			sink.beginRecord(id, featureCode, graphicCode, GeometryType::Line, recordBegin);
+			if (featureType == 1)
+			{
+				//直接坐标线
+				const int count = reader.readLine().toInt();
+				for (int i = 0; i < count; i++)
+				{
+					const int lineType = reader.readLine().toInt();
+					if (lineType == 11)
+					{
+						//折线
+						const int pointCount = reader.readLine().toInt();
+						sink.beginPart();
+						sink.beginRing();
+						for (int j = 0; j < pointCount; j++)
+						{
+							readVertex(reader.readLine(), sink);
+						}
+					}
+				}
+			}
+			sink.endRecord(reader.pos());
+			line = reader.readLine();
+			if (line.equals("0"))
+				line = readNextRecord(reader);
+		}
+	}
+
+	//! Reads the records of a polygon section up to and including its end marker
+	template <class Sink>
+	void readPolygons(LineReader &reader, Sink &sink)
+	{
+		Line line = reader.readLine();
+		while (!line.isNull() && marker(line) != Marker::PolygonEnd)
+		{
+			const int64_t recordBegin = line.data() - reader.data();
+			const int id = line.toInt();
+			const Line featureCode = reader.readLine();
+			const Line graphicCode = reader.readLine();
+			const int featureType = reader.readLine().toInt();
+			//标识点
+			reader.readLine();
+			sink.beginRecord(id, featureCode, graphicCode, GeometryType::Polygon, recordBegin);
+			bool hasPolygon = false;
+			int originalShape = -1;//保存上一个主面的geometryShape
+			if (featureType == 1)
+			{
+				//由直接坐标表示的面对象
+				int borderCount = reader.readLine().toInt();
+				int i = 0;
+				while (i < borderCount + 1 && !reader.atEnd())//假设存在一个附属面
+				{
+					const int geometryShape = reader.readLine().toInt();
+					if (geometryShape == 0)
+					{
+						//全部读取完毕
+						break;
+					}
+					const Line str = reader.readLine();
+					int pointCount;
+					if (!str.contains(','))
+					{
+						//主面
+						originalShape = geometryShape;
+						sink.beginPart();
+						hasPolygon = true;
+						pointCount = str.toInt();
+						if (geometryShape == 11)
+						{
+							sink.beginRing();
+							for (int j = 0; j < pointCount; j++)
+							{
+								readVertex(reader.readLine(), sink);
+							}
+						}
+					}
+					else
+					{
+						//附属面
+						pointCount = geometryShape;
+						if (originalShape == 11 && hasPolygon)
+						{
+							borderCount++;//假设存在下一个附属面
+							sink.beginRing();
+							readVertex(str, sink);
+							for (int j = 0; j < pointCount - 1; j++)
+							{
+								readVertex(reader.readLine(), sink);
+							}
+						}
+					}
+					i++;
+				}
+			}
+			sink.endRecord(reader.pos());
+			line = readNextRecord(reader);
+		}
+	}
+
+	/**
+	 * Reads the tables of an attribute section up to and including its end marker into \a sink, which
+	 * has the members
+	 *
+	 *   void beginTable(const Line &name);
+	 *   void addRow(int id, const Line &row, int64_t begin, int64_t end);
+	 *
+	 * \a row is the whole line of the row, its first field is the feature id, and [begin, end) its byte
+	 * range. A chunk of a section that continues the table of the previous chunk does not start with
+	 * a table name.
+	 */
+	template <class Sink>
+	void readAttributeRows(LineReader &reader, bool startsWithTableName, Sink &sink)
+	{
+		bool tableName = startsWithTableName;
+		Line line = reader.readLine();
+		while (!line.isNull())
+		{
+			const Marker lineMarker = marker(line);
+			if (lineMarker == Marker::AttributeEnd)
+				break;
+			if (tableName)
+			{
+				//the table name line opens every table
+				sink.beginTable(line.trimmed());
+				tableName = false;
+			}
+			else if (lineMarker == Marker::TableEnd)
+			{
+				tableName = true;
+			}
+			else
+			{
+				int pos = 0;
+				Line field;
+				line.nextField(',', pos, field);
+				sink.addRow(field.toInt(), line, line.data() - reader.data(), reader.pos());
+			}
+			line = reader.readLine();
+		}
+	}
+
+	//Number of vertices in all rings of part
+	template <class Store>
+	int partVertexCount(const Store &store, int part)
+	{
+		int count = 0;
+		const int ringBegin = store.partRingBegin(part);
+		const int ringEnd = ringBegin + store.partRingCount(part);
+		for (int ring = ringBegin; ring < ringEnd; ring++)
+			count += store.ringVertexCount(ring);
+		return count;
+	}
+
+	//Number of vertices in all parts of the record at row
+	template <class Store>
+	int recordVertexCount(const Store &store, int row)
+	{
+		int count = 0;
+		const int partBegin = store.featurePartBegin(row);
+		const int partEnd = partBegin + store.featurePartCount(row);
+		for (int part = partBegin; part < partEnd; part++)
+			count += partVertexCount(store, part);
+		return count;
+	}
+
+	template <class Output, class Store>
+	void writeRing(Output &output, const Store &store, int ring)
+	{
+		const int vertexBegin = store.ringVertexBegin(ring);
+		const int vertexEnd = vertexBegin + store.ringVertexCount(ring);
+		for (int vertex = vertexBegin; vertex < vertexEnd; vertex++)
+			output.writeCoordinate(store.x(vertex), store.y(vertex));
+	}
+
+	template <class Output, class Store>
+	void writePart(Output &output, const Store &store, int part)
+	{
+		const int ringBegin = store.partRingBegin(part);
+		const int ringEnd = ringBegin + store.partRingCount(part);
+		for (int ring = ringBegin; ring < ringEnd; ring++)
+			writeRing(output, store, ring);
+	}
+
+	/**
+	 * The geometry writers write a record of \a row from the line after its graphic code up to and
+	 * including the blank line after its terminator. \a output has the members write(const char *),
+	 * writeIntegerLine(value) and writeCoordinate(x, y). A point record needs at least one vertex, the
+	 * reader expects a coordinate line: writers skip points without one, their attribute row keeps them.
+	 */
+	template <class Output, class Store>
+	void writePointGeometry(Output &output, const Store &store, int row)
+	{
+		const int partBegin = store.featurePartBegin(row);
+		const int partEnd = partBegin + store.featurePartCount(row);
+		const int pointCount = recordVertexCount(store, row);
+		if (pointCount > 1)
+		{
+			//点簇
+			output.writeIntegerLine(4);
+			output.writeIntegerLine(pointCount);
+		}
+		else
+		{
+			output.writeIntegerLine(1);
+		}
+		for (int part = partBegin; part < partEnd; part++)
+			writePart(output, store, part);
+		output.write("0\n\n");
+	}
+
+	template <class Output, class Store>
+	void writeLineGeometry(Output &output, const Store &store, int row)
+	{
+		const int partBegin = store.featurePartBegin(row);
+		const int partCount = store.featurePartCount(row);
+		output.writeIntegerLine(1);//直接坐标线
+		if (partCount > 0)
+		{
+			output.writeIntegerLine(partCount);
+			for (int part = partBegin; part < partBegin + partCount; part++)
+			{
+				output.writeIntegerLine(11);//折线
+				output.writeIntegerLine(partVertexCount(store, part));
+				writePart(output, store, part);
+			}
+		}
+		else
+		{
+			output.writeIntegerLine(1);
+			output.writeIntegerLine(11);//折线
+			output.writeIntegerLine(0);
+		}
+		output.write("0\n\n");
+	}
+
+	template <class Output, class Store>
+	void writePolygonGeometry(Output &output, const Store &store, int row)
+	{
+		output.write("1\n0.0,0.0\n");//由直接坐标表示的面对象
+		const int partBegin = store.featurePartBegin(row);
+		const int partCount = store.featurePartCount(row);
+		if (partCount > 0)
+		{
+			output.writeIntegerLine(partCount);//圈数
+			for (int part = partBegin; part < partBegin + partCount; part++)
+			{
+				output.writeIntegerLine(11);//多边形
+				const int ringBegin = store.partRingBegin(part);
+				const int ringEnd = ringBegin + store.partRingCount(part);
+				for (int ring = ringBegin; ring < ringEnd; ring++)
+				{
+					output.writeIntegerLine(store.ringVertexCount(ring));//点数
+					writeRing(output, store, ring);
+				}
+			}
+		}
+		else
+		{
+			output.writeIntegerLine(1);//圈数
+			output.writeIntegerLine(11);//多边形
+		}
+		output.write("0\n\n");
+	}
+}